@@ -0,0 +1,281 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+// Dynamically sized bitset over contributor ids, laid out as plain 64-bit words so that
+// the hot loops can combine several sets word by word.
+//
+// A sparse bitset only stores its non-zero words, along with their indices, so a set of a handful of contributors
+// costs a handful of words however many contributors there are. Sparse bitsets answer every query below except data()
+// and the in-place operations on whole sets other than &=, and the static queries walk the stored words of a sparse
+// operand instead of all the words
+class Bitset
+{
+public:
+    Bitset() = default;
+
+    explicit Bitset(uint32_t nr_bits, bool sparse = false)
+            : nr_bits(nr_bits)
+            , sparse(sparse)
+            , words(sparse ? 0 : (nr_bits + 63) / 64, 0)
+    {}
+
+    void set(uint32_t index)
+    {
+        word_for_update(index >> 6) |= (uint64_t(1) << (index & 63));
+    }
+
+    void reset(uint32_t index)
+    {
+        if (!sparse)
+        {
+            words[index >> 6] &= ~(uint64_t(1) << (index & 63));
+            return;
+        }
+        uint32_t position = position_of(index >> 6);
+        if (position == word_indices.size() || word_indices[position] != index >> 6)
+            return;
+        // Zero words are dropped, so that the stored words stay the non-zero ones
+        if (!(words[position] &= ~(uint64_t(1) << (index & 63))))
+        {
+            words.erase(words.begin() + position);
+            word_indices.erase(word_indices.begin() + position);
+        }
+    }
+
+    [[nodiscard]] bool test(uint32_t index) const
+    {
+        return (word(index >> 6) >> (index & 63)) & 1;
+    }
+
+    [[nodiscard]] bool is_sparse() const
+    {
+        return sparse;
+    }
+
+    // Word word_index of the set, also for sparse sets
+    [[nodiscard]] uint64_t word(uint32_t word_index) const
+    {
+        if (!sparse)
+            return words[word_index];
+        uint32_t position = position_of(word_index);
+        return position < word_indices.size() && word_indices[position] == word_index ? words[position] : 0;
+    }
+
+    // First word from word_index on that is not zero, nr_words() if there is none
+    [[nodiscard]] uint32_t next_word(uint32_t word_index) const
+    {
+        if (sparse)
+        {
+            uint32_t position = position_of(word_index);
+            return position < word_indices.size() ? word_indices[position] : nr_words();
+        }
+        while (word_index < words.size() && !words[word_index])
+            ++word_index;
+        return word_index;
+    }
+
+    [[nodiscard]] bool any() const
+    {
+        for (const auto word : words)
+            if (word)
+                return true;
+        return false;
+    }
+
+    [[nodiscard]] uint32_t count() const
+    {
+        uint32_t total = 0;
+        for (const auto word : words)
+            total += std::popcount(word);
+        return total;
+    }
+
+    [[nodiscard]] uint32_t size() const
+    {
+        return nr_bits;
+    }
+
+    [[nodiscard]] uint32_t nr_words() const
+    {
+        return (nr_bits + 63) / 64;
+    }
+
+    [[nodiscard]] const uint64_t* data() const
+    {
+        return words.data();
+    }
+
+    [[nodiscard]] uint64_t* data()
+    {
+        return words.data();
+    }
+
+    // Only on a dense set, other can be sparse
+    Bitset& operator&=(const Bitset& other)
+    {
+        for (uint32_t index = 0; index < words.size(); ++index)
+            words[index] &= other.word(index);
+        return *this;
+    }
+
+    void clear()
+    {
+        if (sparse)
+        {
+            words.clear();
+            word_indices.clear();
+        }
+        else
+            std::fill(words.begin(), words.end(), 0);
+    }
+
+    void set_all()
+    {
+        std::fill(words.begin(), words.end(), ~uint64_t(0));
+        if (nr_bits & 63)
+            words.back() = (uint64_t(1) << (nr_bits & 63)) - 1;
+    }
+
+    static constexpr uint32_t npos = UINT32_MAX;
+
+    [[nodiscard]] static bool intersects(const Bitset& lhs, const Bitset& rhs)
+    {
+        if (lhs.sparse || rhs.sparse)
+            return any_sparse(lhs, rhs, [&](uint32_t index){ return lhs.word(index) & rhs.word(index); });
+        uint64_t common = 0;
+        for (uint32_t index = 0; index < lhs.words.size(); ++index)
+            common |= lhs.words[index] & rhs.words[index];
+        return common != 0;
+    }
+
+    [[nodiscard]] static bool intersects(const Bitset& first, const Bitset& second, const Bitset& third)
+    {
+        if (first.sparse || second.sparse || third.sparse)
+            return any_sparse(first.sparse ? first : second.sparse ? second : third, [&](uint32_t index){
+                return first.word(index) & second.word(index) & third.word(index);
+            });
+        uint64_t common = 0;
+        for (uint32_t index = 0; index < first.words.size(); ++index)
+            common |= first.words[index] & second.words[index] & third.words[index];
+        return common != 0;
+    }
+
+    // Whether some index is set in both lhs and rhs but not in excluded
+    [[nodiscard]] static bool intersects_excluding(const Bitset& lhs, const Bitset& rhs, const Bitset& excluded)
+    {
+        if (lhs.sparse || rhs.sparse)
+            return any_sparse(lhs, rhs, [&](uint32_t index){
+                return lhs.word(index) & rhs.word(index) & ~excluded.word(index);
+            });
+        uint64_t common = 0;
+        for (uint32_t index = 0; index < lhs.words.size(); ++index)
+            common |= lhs.words[index] & rhs.words[index] & ~excluded.words[index];
+        return common != 0;
+    }
+
+    [[nodiscard]] static uint32_t count_common(const Bitset& lhs, const Bitset& rhs)
+    {
+        uint32_t total = 0;
+        if (lhs.sparse || rhs.sparse)
+        {
+            const auto& stored = lhs.sparse ? lhs : rhs;
+            for (uint32_t index : stored.word_indices)
+                total += std::popcount(lhs.word(index) & rhs.word(index));
+            return total;
+        }
+        for (uint32_t index = 0; index < lhs.words.size(); ++index)
+            total += std::popcount(lhs.words[index] & rhs.words[index]);
+        return total;
+    }
+
+    // Lowest index set in both lhs and rhs but not in excluded, npos if there is none
+    [[nodiscard]] static uint32_t first_common(const Bitset& lhs, const Bitset& rhs, const Bitset& excluded)
+    {
+        if (lhs.sparse || rhs.sparse)
+        {
+            const auto& stored = lhs.sparse ? lhs : rhs;
+            for (uint32_t index : stored.word_indices)
+                if (uint64_t word = lhs.word(index) & rhs.word(index) & ~excluded.word(index))
+                    return (index << 6) | std::countr_zero(word);
+            return npos;
+        }
+        for (uint32_t index = 0; index < lhs.words.size(); ++index)
+            if (uint64_t word = lhs.words[index] & rhs.words[index] & ~excluded.words[index])
+                return (index << 6) | std::countr_zero(word);
+        return npos;
+    }
+
+    // Calls visit(index) for every set bit in ascending order, stops as soon as visit returns false
+    template <typename Visitor>
+    bool for_each(Visitor&& visit) const
+    {
+        for (uint32_t position = 0; position < words.size(); ++position)
+        {
+            uint32_t word_index = sparse ? word_indices[position] : position;
+            for (uint64_t word = words[position]; word; word &= word - 1)
+                if (!visit((word_index << 6) | std::countr_zero(word)))
+                    return false;
+        }
+        return true;
+    }
+
+    // Same as for_each, but only visits the bits that are also set in mask
+    template <typename Visitor>
+    bool for_each_common(const Bitset& mask, Visitor&& visit) const
+    {
+        for (uint32_t position = 0; position < words.size(); ++position)
+        {
+            uint32_t word_index = sparse ? word_indices[position] : position;
+            for (uint64_t word = words[position] & mask.word(word_index); word; word &= word - 1)
+                if (!visit((word_index << 6) | std::countr_zero(word)))
+                    return false;
+        }
+        return true;
+    }
+
+private:
+    uint32_t nr_bits = 0;
+    bool sparse = false;
+    // All the words of a dense set, the non-zero words of a sparse one
+    std::vector<uint64_t> words;
+    // Index of every stored word of a sparse set, ascending
+    std::vector<uint32_t> word_indices;
+
+    // Position of the first stored word with an index of at least word_index
+    [[nodiscard]] uint32_t position_of(uint32_t word_index) const
+    {
+        return std::lower_bound(word_indices.begin(), word_indices.end(), word_index) - word_indices.begin();
+    }
+
+    uint64_t& word_for_update(uint32_t word_index)
+    {
+        if (!sparse)
+            return words[word_index];
+        uint32_t position = position_of(word_index);
+        if (position == word_indices.size() || word_indices[position] != word_index)
+        {
+            word_indices.insert(word_indices.begin() + position, word_index);
+            words.insert(words.begin() + position, 0);
+        }
+        return words[position];
+    }
+
+    // Whether non_zero(index) holds for a stored word of the sparse set
+    template <typename NonZero>
+    static bool any_sparse(const Bitset& stored, NonZero&& non_zero)
+    {
+        for (uint32_t index : stored.word_indices)
+            if (non_zero(index))
+                return true;
+        return false;
+    }
+
+    template <typename NonZero>
+    static bool any_sparse(const Bitset& lhs, const Bitset& rhs, NonZero&& non_zero)
+    {
+        return any_sparse(lhs.sparse ? lhs : rhs, non_zero);
+    }
+};
@@ -0,0 +1,212 @@
+#pragma once
+#include <bit>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Data.h"
+#include "MappedFile.h"
+#include "SimulationState.h"
+
+// Binary snapshot of a running simulation: day, score, allocations, contributor levels, availability and done projects,
+// which is all it takes to continue the run. A fixed header is followed by plain arrays of native integers, so loading
+// is a pass over the memory mapped file. Levels are saved as the cells that differ from the input, which keeps a
+// checkpoint about as small as the schedule so far.
+//
+// A checkpoint is written under a temporary name and renamed over the previous one, so a crash while writing leaves
+// the previous checkpoint in place
+class Checkpoint
+{
+public:
+    // Bumped on every change to the layout, older files are rejected
+    static constexpr uint32_t VERSION = 1;
+
+    static void write(const std::string& filename, const Data& data, const SimulationState& state)
+    {
+        Header header{};
+        std::memcpy(header.magic, MAGIC, sizeof(header.magic));
+        header.version = VERSION;
+        header.fingerprint = fingerprint(data);
+        header.day = state.day;
+        header.score = state.score_so_far;
+        header.nr_allocations = state.proj_to_contrib.size();
+
+        std::vector<uint32_t> allocations;
+        for (const auto& [project_index, contributor_ids] : state.proj_to_contrib)
+        {
+            allocations.push_back(project_index);
+            allocations.push_back(contributor_ids.size());
+            allocations.insert(allocations.end(), contributor_ids.begin(), contributor_ids.end());
+        }
+        header.allocations_size = allocations.size();
+
+        // Levels only go up during a simulation, so every changed cell is among the skills the contributor has now
+        std::vector<LevelChange> level_changes;
+        for (uint32_t contr_id = 0; contr_id < (uint32_t)data.nr_contributors; ++contr_id)
+            for (const auto& [skill_id, level] : state.skill_matrix.skills_of_contributor(contr_id))
+                if (level != data.skill_matrix.level(contr_id, skill_id))
+                    level_changes.push_back({contr_id, skill_id, (uint32_t)level});
+        header.nr_level_changes = level_changes.size();
+
+        std::vector<uint8_t> done((data.nr_projects + 7) / 8, 0);
+        for (int project_index = 0; project_index < data.nr_projects; ++project_index)
+            if (state.project_done[project_index])
+                done[project_index / 8] |= 1 << (project_index % 8);
+
+        const auto temporary = filename + ".tmp";
+        FILE* file = std::fopen(temporary.c_str(), "wb");
+        if (!file)
+            throw std::runtime_error("Cannot write " + temporary);
+        bool written = put(file, &header, sizeof(header)) &&
+                       put(file, state.available_at.data(), state.available_at.size() * sizeof(int32_t)) &&
+                       put(file, done.data(), done.size()) &&
+                       put(file, allocations.data(), allocations.size() * sizeof(uint32_t)) &&
+                       put(file, level_changes.data(), level_changes.size() * sizeof(LevelChange));
+        written = std::fclose(file) == 0 && written;
+        if (!written)
+            throw std::runtime_error("Cannot write " + temporary);
+        std::filesystem::rename(temporary, filename);
+    }
+
+    // The state saved for this input, or nothing if there is no checkpoint or it was saved for another input or by
+    // another version. Throws on files that are cut short or hold ids out of range for the input
+    static std::optional<SimulationState> read(const std::string& filename, const Data& data)
+    {
+        if (!std::filesystem::exists(filename))
+            return std::nullopt;
+        MappedFile file(filename);
+        auto bytes = file.view();
+
+        Header header{};
+        take(bytes, &header, sizeof(header));
+        if (std::memcmp(header.magic, MAGIC, sizeof(header.magic)) || header.version != VERSION ||
+            header.fingerprint != fingerprint(data))
+            return std::nullopt;
+
+        std::vector<int32_t> available_at(data.nr_contributors);
+        take(bytes, available_at.data(), available_at.size() * sizeof(int32_t));
+        std::vector<uint8_t> done((data.nr_projects + 7) / 8);
+        take(bytes, done.data(), done.size());
+        // Sized from the header only once the rest of the file is known to hold them
+        if (header.allocations_size > bytes.size() / sizeof(uint32_t))
+            throw std::runtime_error("Checkpoint is cut short");
+        if (header.nr_level_changes > (bytes.size() - header.allocations_size * sizeof(uint32_t)) / sizeof(LevelChange))
+            throw std::runtime_error("Checkpoint is cut short");
+        std::vector<uint32_t> allocations(header.allocations_size);
+        take(bytes, allocations.data(), allocations.size() * sizeof(uint32_t));
+        std::vector<LevelChange> level_changes(header.nr_level_changes);
+        take(bytes, level_changes.data(), level_changes.size() * sizeof(LevelChange));
+
+        auto skill_matrix = data.skill_matrix;
+        for (const auto& [contr_id, skill_id, level] : level_changes)
+        {
+            expect(contr_id < (uint32_t)data.nr_contributors && skill_id < data.skill_matrix.nr_skills &&
+                   level <= MAX_LEVEL);
+            skill_matrix.set_level(contr_id, skill_id, level);
+        }
+
+        std::optional<SimulationState> state(std::in_place, data, skill_matrix);
+        state->day = header.day;
+        state->score_so_far = header.score;
+        for (size_t offset = 0; offset < allocations.size();)
+        {
+            if (offset + 2 > allocations.size() || offset + 2 + allocations[offset + 1] > allocations.size())
+                throw std::runtime_error("Checkpoint is cut short");
+            auto& [project_index, contributor_ids] = state->proj_to_contrib.emplace_back();
+            uint32_t nr_contributors = allocations[offset + 1];
+            expect(allocations[offset] < (uint32_t)data.nr_projects &&
+                   nr_contributors == data.projects.roles(allocations[offset]).size());
+            project_index = allocations[offset];
+            contributor_ids.assign(allocations.begin() + offset + 2, allocations.begin() + offset + 2 + nr_contributors);
+            for (uint32_t contr_id : contributor_ids)
+                expect(contr_id < (uint32_t)data.nr_contributors);
+            offset += 2 + nr_contributors;
+        }
+        if (state->proj_to_contrib.size() != header.nr_allocations)
+            throw std::runtime_error("Checkpoint is cut short");
+        for (int project_index = 0; project_index < data.nr_projects; ++project_index)
+            state->project_done[project_index] = done[project_index / 8] >> (project_index % 8) & 1;
+        for (uint32_t contr_id = 0; contr_id < (uint32_t)data.nr_contributors; ++contr_id)
+        {
+            state->available_at[contr_id] = available_at[contr_id];
+            if (available_at[contr_id] > header.day)
+            {
+                state->available.reset(contr_id);
+                state->release_queue.push(contr_id, available_at[contr_id]);
+            }
+        }
+        state->rebuild_project_queue();
+        return state;
+    }
+
+    // Tells inputs apart, so that a checkpoint is never resumed on the wrong one
+    static uint64_t fingerprint(const Data& data)
+    {
+        // FNV-1a
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        auto mix = [&hash](uint64_t value){
+            for (int byte = 0; byte < 8; ++byte)
+            {
+                hash ^= (value >> (8 * byte)) & 0xff;
+                hash *= 0x100000001b3ULL;
+            }
+        };
+        mix(data.nr_contributors);
+        mix(data.nr_projects);
+        mix(data.skill_matrix.nr_skills);
+        for (int project_index = 0; project_index < data.nr_projects; ++project_index)
+        {
+            mix(data.projects.length_in_days[project_index]);
+            mix(data.projects.score[project_index]);
+            mix(data.projects.best_before_day[project_index]);
+            for (const auto& [skill_id, level_req] : data.projects.roles(project_index))
+                mix((uint64_t)skill_id << 32 | level_req);
+        }
+        return hash;
+    }
+
+private:
+    static_assert(std::endian::native == std::endian::little, "checkpoints are stored little endian");
+
+    static constexpr char MAGIC[8] = {'S', 'O', 'L', '1', 'C', 'K', 'P', 'T'};
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        int32_t day;
+        uint64_t fingerprint;
+        int64_t score;
+        uint64_t nr_allocations, allocations_size, nr_level_changes;
+    };
+
+    struct LevelChange
+    {
+        uint32_t contr_id, skill_id, level;
+    };
+
+    static bool put(FILE* file, const void* bytes, size_t size)
+    {
+        return std::fwrite(bytes, 1, size, file) == size;
+    }
+
+    // The ids of a checkpoint are only used once they are known to fit the input
+    static void expect(bool in_range)
+    {
+        if (!in_range)
+            throw std::runtime_error("Checkpoint is corrupt");
+    }
+
+    static void take(std::string_view& bytes, void* destination, size_t size)
+    {
+        if (bytes.size() < size)
+            throw std::runtime_error("Checkpoint is cut short");
+        std::memcpy(destination, bytes.data(), size);
+        bytes.remove_prefix(size);
+    }
+};
@@ -1,112 +1,284 @@
 #pragma once
 #include <algorithm>
+#include <cstdint>
 #include <fstream>
-#include <map>
-#include <unordered_set>
+#include <numeric>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
-#define MAX_PROJECTS 19413
-using ProjectAllocation = std::pair<int, std::vector<std::string>>;
+#include "MappedFile.h"
+#include "SkillMatrix.h"
 
-struct Project
+using ProjectAllocation = std::pair<int, std::vector<uint32_t>>;
+// Skill id and the level required for it
+using SkillToLevel = std::pair<uint32_t, int>;
+
+// Maps names to dense ids so that the simulation can work on plain array indices. The names are views into the
+// input, which has to outlive the table
+struct SymbolTable
 {
-    std::string name;
-    int length_in_days, score, best_before_day;
-    std::vector<std::pair<std::string, int>> skill_to_level;
-
-    Project(std::string&& name,
-            int length_in_days,
-            int score,
-            int best_before_day,
-            std::vector<std::pair<std::string, int>>&& skill_to_level)
-            : name(std::move(name))
-            , length_in_days(length_in_days)
-            , score(score)
-            , best_before_day(best_before_day)
-            , skill_to_level(std::move(skill_to_level))
-    {}
+    std::vector<std::string_view> names;
+    std::unordered_map<std::string_view, uint32_t> ids;
+
+    uint32_t intern(std::string_view name)
+    {
+        auto [it, inserted] = ids.try_emplace(name, (uint32_t)names.size());
+        if (inserted)
+            names.push_back(name);
+        return it->second;
+    }
+
+    [[nodiscard]] uint32_t size() const
+    {
+        return names.size();
+    }
 };
 
-class Data
+// All the projects, one column per field, so that the queue, the filter and the scoring kernels below walk contiguous
+// arrays of ints instead of hopping from project to project. The roles of all projects share one flat array
+struct ProjectTable
 {
-public:
-    int nr_contributors, nr_projects;
-    std::map<std::string, std::set<std::string>[21]> skill_to_contributors;
-    std::vector<Project> projects;
+    std::vector<std::string_view> name;
+    std::vector<int> length_in_days, score, best_before_day;
+    // The roles of project p are all_roles[role_offset[p]] to all_roles[role_offset[p + 1]]
+    std::vector<uint32_t> role_offset{0};
+    std::vector<SkillToLevel> all_roles;
+    // The projects with a role in skill s, each once and in index order, are projects_by_skill from skill_offset[s]
+    // to skill_offset[s + 1], see index_skills
+    std::vector<uint32_t> skill_offset;
+    std::vector<int> projects_by_skill;
+    // Whether one of the roles of the project is of level 1, which anyone can fill with mentoring
+    std::vector<bool> has_level_one_role;
 
-    Data(const std::string& filename)
+    [[nodiscard]] int size() const
     {
-        std::ifstream fin(filename);
-        fin >> nr_contributors >> nr_projects;
+        return score.size();
+    }
+
+    [[nodiscard]] std::span<const SkillToLevel> roles(int project_index) const
+    {
+        return {all_roles.data() + role_offset[project_index], all_roles.data() + role_offset[project_index + 1]};
+    }
 
-        // avoid re-allocations and over-allocations
-        projects.reserve(nr_projects);
+    [[nodiscard]] int nr_roles(int project_index) const
+    {
+        return role_offset[project_index + 1] - role_offset[project_index];
+    }
+
+    [[nodiscard]] std::span<const int> projects_with_skill(uint32_t skill_id) const
+    {
+        return {projects_by_skill.data() + skill_offset[skill_id], projects_by_skill.data() + skill_offset[skill_id + 1]};
+    }
+
+    // Builds projects_by_skill and has_level_one_role from the roles
+    void index_skills(uint32_t nr_skills)
+    {
+        // Two passes over the roles, counting then placing, with the last project seen per skill to skip repeats
+        std::vector<int> last_project(nr_skills, -1);
+        skill_offset.assign(nr_skills + 1, 0);
+        has_level_one_role.assign(size(), false);
+        for (int project_index = 0; project_index < size(); ++project_index)
+            for (const auto& [skill_id, level] : roles(project_index))
+            {
+                if (last_project[skill_id] != project_index)
+                {
+                    last_project[skill_id] = project_index;
+                    ++skill_offset[skill_id + 1];
+                }
+                if (level <= 1)
+                    has_level_one_role[project_index] = true;
+            }
+        std::partial_sum(skill_offset.begin(), skill_offset.end(), skill_offset.begin());
+
+        std::vector<uint32_t> next(skill_offset.begin(), skill_offset.end() - 1);
+        std::fill(last_project.begin(), last_project.end(), -1);
+        projects_by_skill.resize(skill_offset.back());
+        for (int project_index = 0; project_index < size(); ++project_index)
+            for (const auto& [skill_id, level] : roles(project_index))
+                if (last_project[skill_id] != project_index)
+                {
+                    last_project[skill_id] = project_index;
+                    projects_by_skill[next[skill_id]++] = project_index;
+                }
+    }
+
+    // Last day the project can start and still finish on time
+    [[nodiscard]] int latest_start(int project_index) const
+    {
+        return best_before_day[project_index] - length_in_days[project_index];
+    }
+
+    // Score of the project when it starts on this day, one point less per day it finishes late
+    [[nodiscard]] int actual_score(int project_index, int day) const
+    {
+        return std::max(0, score[project_index] - std::max(0, day + length_in_days[project_index] - best_before_day[project_index]));
+    }
 
-        std::map<std::string, std::unordered_set<std::string>> contr_to_skills;
+    // actual_score on this day of every project in project_indices, into scores
+    void actual_scores(int day, std::span<const int> project_indices, std::span<int> scores) const
+    {
+        const int* lengths = length_in_days.data();
+        const int* scores_in = score.data();
+        const int* best_before = best_before_day.data();
+        for (size_t index = 0; index < project_indices.size(); ++index)
+        {
+            int project_index = project_indices[index];
+            int penalty = std::max(0, day + lengths[project_index] - best_before[project_index]);
+            scores[index] = std::max(0, scores_in[project_index] - penalty);
+        }
+    }
 
-        // Read the contributor info
-        for (int contr_index = 0; contr_index < nr_contributors; ++contr_index)
+    // Day-independent keys of the heuristic score of every project, the one place it is defined. The heuristic score is
+    // score^2 - length * roles, minus 3 per day the project could still wait before starting and minus 1 per day it
+    // would finish late: early_keys[p] + 3 * day before the latest on-time start of p, late_keys[p] - day from then on
+    void heuristic_keys(std::span<int64_t> early_keys, std::span<int64_t> late_keys) const
+    {
+        const int* lengths = length_in_days.data();
+        const int* scores_in = score.data();
+        const int* best_before = best_before_day.data();
+        const uint32_t* offsets = role_offset.data();
+        for (size_t project_index = 0; project_index < early_keys.size(); ++project_index)
         {
-            std::string contr_name;
-            int nr_skills;
-            fin >> contr_name >> nr_skills;
+            int64_t base = (int64_t)scores_in[project_index] * scores_in[project_index] -
+                           (int64_t)lengths[project_index] * (offsets[project_index + 1] - offsets[project_index]);
+            int64_t latest_start = best_before[project_index] - lengths[project_index];
+            early_keys[project_index] = base - 3 * latest_start;
+            late_keys[project_index] = base + latest_start;
+        }
+    }
+};
+
+// Everything is sized from the counts in the input. Measured on generated inputs with the sparse skill layout, mapped
+// input included: a project with 10 roles costs about 265 bytes here and 100 more in every simulation state, a
+// contributor with 5 skills about 1 KB here and 700 bytes per state, and a skill about 3 KB here and 3 KB per state.
+// The dense skill layout adds about 6.5 bytes per (contributor, skill) pair to each of them, see SkillMatrix
+class Data
+{
+public:
+    int nr_contributors, nr_projects;
+    SymbolTable skills, contributors;
+    SkillMatrix skill_matrix;
+    // Sorted by best before day
+    ProjectTable projects;
 
-            std::unordered_set<std::string> skills;
-            while (nr_skills--)
+    // The input is mapped and tokenized in place, every name is a view into the mapping
+    Data(const std::string& filename, SkillLayout skill_layout = SkillLayout::Auto)
+            : input(filename)
+    {
+        Tokenizer tokenizer(input.view());
+        nr_contributors = tokenizer.next_int();
+        nr_projects = tokenizer.next_int();
+
+        // Read the contributor info, the skills of all contributors go into one flat array
+        struct ContributorEntry
+        {
+            std::string_view name;
+            uint32_t first_skill, nr_skills;
+        };
+        std::vector<ContributorEntry> contr_entries(nr_contributors);
+        std::vector<SkillToLevel> contr_skills;
+        for (auto& [contr_name, first_skill, nr_skills] : contr_entries)
+        {
+            contr_name = tokenizer.next_word();
+            nr_skills = tokenizer.next_int();
+            first_skill = contr_skills.size();
+            for (uint32_t skill_index = 0; skill_index < nr_skills; ++skill_index)
             {
-                std::string skill_name;
-                int skill_level;
-                fin >> skill_name >> skill_level;
-                skills.insert(skill_name);
-                skill_to_contributors[skill_name][skill_level].insert(contr_name);
+                auto skill_name = tokenizer.next_word();
+                int skill_level = tokenizer.next_int();
+                contr_skills.emplace_back(skills.intern(skill_name), skill_level);
             }
-            contr_to_skills[contr_name] = skills;
         }
-        // Read the project info
+
+        // Contributor ids follow name order, so the per-level bitsets are iterated in the same order as names would be
+        std::sort(contr_entries.begin(), contr_entries.end(), [](const auto& lhs, const auto& rhs){
+            return lhs.name < rhs.name;
+        });
+        contributors.names.reserve(nr_contributors);
+        contributors.ids.reserve(nr_contributors);
+        for (const auto& entry : contr_entries)
+            contributors.intern(entry.name);
+
+        // Read the project info, in input order for now
+        ProjectTable unsorted;
+        unsorted.name.reserve(nr_projects);
+        unsorted.length_in_days.reserve(nr_projects);
+        unsorted.score.reserve(nr_projects);
+        unsorted.best_before_day.reserve(nr_projects);
+        unsorted.role_offset.reserve(nr_projects + 1);
         for (int proj_index = 0; proj_index < nr_projects; ++proj_index)
         {
-            std::string name;
-            int length_in_days, score, best_before_day, nr_roles;
-            std::vector<std::pair<std::string, int>> skill_to_level;
-            fin >> name >> length_in_days >> score >> best_before_day >> nr_roles;
-            skill_to_level.reserve(nr_roles);
-
+            unsorted.name.push_back(tokenizer.next_word());
+            unsorted.length_in_days.push_back(tokenizer.next_int());
+            unsorted.score.push_back(tokenizer.next_int());
+            unsorted.best_before_day.push_back(tokenizer.next_int());
+            int nr_roles = tokenizer.next_int();
             while (nr_roles--)
             {
-                std::string skill_name;
-                int skill_level;
-                fin >> skill_name >> skill_level;
-                skill_to_level.emplace_back(skill_name, skill_level);
+                auto skill_name = tokenizer.next_word();
+                int skill_level = tokenizer.next_int();
+                unsorted.all_roles.emplace_back(skills.intern(skill_name), skill_level);
             }
-
-            projects.emplace_back(std::move(name), length_in_days, score, best_before_day, std::move(skill_to_level));
+            unsorted.role_offset.push_back(unsorted.all_roles.size());
         }
 
-        // No skill in input means skill at level 0(can be improved with mentoring)
-        for (auto& [contr_name, skills] : contr_to_skills)
-            for (auto& [skill_name, contr_to_skills_per_level] : skill_to_contributors)
-                if (!skills.contains(skill_name))
-                {
-                    auto& level0_set_for_skill = contr_to_skills_per_level[0];
-                    level0_set_for_skill.insert(contr_name);
-                }
+        // No skill in input means skill at level 0(can be improved with mentoring), which the matrix starts from
+        skill_matrix = SkillMatrix(contributors.size(), skills.size(), skill_layout);
+        for (uint32_t contr_id = 0; contr_id < contributors.size(); ++contr_id)
+        {
+            const auto& entry = contr_entries[contr_id];
+            for (uint32_t skill_index = entry.first_skill; skill_index < entry.first_skill + entry.nr_skills; ++skill_index)
+                skill_matrix.set_level(contr_id, contr_skills[skill_index].first, contr_skills[skill_index].second);
+        }
 
         // Sort projects based on best before day
-        std::sort(projects.begin(), projects.end(), [](const auto& lhs, const auto& rhs){
-            return lhs.best_before_day < rhs.best_before_day;
+        std::vector<int> order(nr_projects);
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&unsorted](int lhs, int rhs){
+            return unsorted.best_before_day[lhs] < unsorted.best_before_day[rhs];
         });
+        projects.all_roles.reserve(unsorted.all_roles.size());
+        projects.role_offset.reserve(nr_projects + 1);
+        for (int proj_index : order)
+        {
+            projects.name.push_back(unsorted.name[proj_index]);
+            projects.length_in_days.push_back(unsorted.length_in_days[proj_index]);
+            projects.score.push_back(unsorted.score[proj_index]);
+            projects.best_before_day.push_back(unsorted.best_before_day[proj_index]);
+            auto roles = unsorted.roles(proj_index);
+            projects.all_roles.insert(projects.all_roles.end(), roles.begin(), roles.end());
+            projects.role_offset.push_back(projects.all_roles.size());
+        }
+        projects.index_skills(skills.size());
     }
 
-    void write_to_file(const std::string& filename, const std::vector<ProjectAllocation>& allocation) const
+    // Appends the allocation in the output format: the project name on one line, the names of its contributors on
+    // the next
+    void append_allocation(std::string& out, const ProjectAllocation& allocation) const
     {
-        std::ofstream fout(filename);
-        fout << allocation.size() << '\n';
-        for (const auto& [project_id, contributor_names] : allocation)
+        const auto& [project_id, contributor_ids] = allocation;
+        out.append(projects.name[project_id]);
+        out.push_back('\n');
+        for (const auto& contributor_id : contributor_ids)
         {
-            fout << projects[project_id].name << '\n';
-            for (const auto& contributor_name : contributor_names)
-                fout << contributor_name << " ";
-            fout << '\n';
+            out.append(contributors.names[contributor_id]);
+            out.push_back(' ');
         }
+        out.push_back('\n');
+    }
+
+    void write_to_file(const std::string& filename, const std::vector<ProjectAllocation>& allocation) const
+    {
+        std::string out = std::to_string(allocation.size()) + '\n';
+        for (const auto& project_allocation : allocation)
+            append_allocation(out, project_allocation);
+        std::ofstream(filename, std::ios::binary).write(out.data(), (std::streamsize)out.size());
     }
-};
\ No newline at end of file
+
+private:
+    // Backing storage of all the names
+    MappedFile input;
+};
@@ -0,0 +1,122 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "SkillMatrix.h"
+
+// Shape of a synthetic instance. The defaults are about the size of f
+struct GeneratorConfig
+{
+    uint32_t nr_contributors = 1000;
+    uint32_t nr_projects = 19000;
+    uint32_t nr_skills = 500;
+    // Skills per contributor and roles per project are drawn from 1 to these
+    int max_skills_per_contributor = 10;
+    int max_roles = 20;
+    // Skill levels and role levels are drawn from 1 to this, at most MAX_LEVEL
+    int max_level = 10;
+    int max_length_in_days = 100;
+    int max_score = 1000;
+    // Best before days are drawn up to this
+    int horizon = 10000;
+    uint64_t seed = 1;
+
+    // Same proportions as the defaults, with factor times as many contributors, projects and skills
+    static GeneratorConfig scaled(double factor, uint64_t seed = 1)
+    {
+        GeneratorConfig config;
+        config.nr_contributors = std::max(1.0, config.nr_contributors * factor);
+        config.nr_projects = std::max(1.0, config.nr_projects * factor);
+        config.nr_skills = std::max(1.0, config.nr_skills * factor);
+        config.horizon = std::max(1.0, config.horizon * factor);
+        config.seed = seed;
+        return config;
+    }
+};
+
+// Writes random instances in the input format. The same config always gives the same file, on every platform, as the
+// random numbers come from a fixed generator instead of the implementation defined standard distributions
+class Generator
+{
+public:
+    static void write_instance(const GeneratorConfig& config, const std::string& filename)
+    {
+        Random random(config.seed);
+        const int max_level = std::clamp(config.max_level, 1, MAX_LEVEL);
+        std::string text;
+        text.reserve((size_t)config.nr_projects * config.max_roles * 12);
+
+        text += std::to_string(config.nr_contributors) + ' ' + std::to_string(config.nr_projects) + '\n';
+
+        std::vector<uint32_t> skill_ids;
+        for (uint32_t contr_id = 0; contr_id < config.nr_contributors; ++contr_id)
+        {
+            distinct_skills(random, config.nr_skills, 1 + random.below(config.max_skills_per_contributor), skill_ids);
+            text += 'c' + std::to_string(contr_id) + ' ' + std::to_string(skill_ids.size()) + '\n';
+            for (uint32_t skill_id : skill_ids)
+                text += 's' + std::to_string(skill_id) + ' ' + std::to_string(1 + random.below(max_level)) + '\n';
+        }
+
+        for (uint32_t project_id = 0; project_id < config.nr_projects; ++project_id)
+        {
+            int length_in_days = 1 + random.below(config.max_length_in_days);
+            int score = 1 + random.below(config.max_score);
+            int best_before_day = 1 + random.below(config.horizon);
+            distinct_skills(random, config.nr_skills, 1 + random.below(config.max_roles), skill_ids);
+
+            text += 'p' + std::to_string(project_id) + ' ' + std::to_string(length_in_days) + ' ' +
+                    std::to_string(score) + ' ' + std::to_string(best_before_day) + ' ' +
+                    std::to_string(skill_ids.size()) + '\n';
+            for (uint32_t skill_id : skill_ids)
+                text += 's' + std::to_string(skill_id) + ' ' + std::to_string(1 + random.below(max_level)) + '\n';
+        }
+
+        FILE* file = std::fopen(filename.c_str(), "wb");
+        if (!file)
+            throw std::runtime_error("Cannot write " + filename);
+        std::fwrite(text.data(), 1, text.size(), file);
+        std::fclose(file);
+    }
+
+private:
+    // splitmix64
+    struct Random
+    {
+        uint64_t state;
+
+        explicit Random(uint64_t seed)
+                : state(seed)
+        {}
+
+        uint64_t next()
+        {
+            uint64_t mixed = (state += 0x9e3779b97f4a7c15ULL);
+            mixed = (mixed ^ (mixed >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            mixed = (mixed ^ (mixed >> 27)) * 0x94d049bb133111ebULL;
+            return mixed ^ (mixed >> 31);
+        }
+
+        // Uniform enough in [0, bound) for bounds far below 2^32
+        int below(uint32_t bound)
+        {
+            return (int)(((next() >> 32) * bound) >> 32);
+        }
+    };
+
+    // count different skill ids, fewer if there are not that many skills
+    static void distinct_skills(Random& random, uint32_t nr_skills, uint32_t count, std::vector<uint32_t>& skill_ids)
+    {
+        count = std::min(count, nr_skills);
+        skill_ids.clear();
+        while (skill_ids.size() < count)
+        {
+            uint32_t skill_id = random.below(nr_skills);
+            if (std::find(skill_ids.begin(), skill_ids.end(), skill_id) == skill_ids.end())
+                skill_ids.push_back(skill_id);
+        }
+    }
+};
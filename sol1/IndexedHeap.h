@@ -0,0 +1,156 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+// d-ary heap over the ids [0, capacity), each id present at most once. Keeping the position of every id
+// allows its key to be changed or the id to be removed in O(log n) without leaving stale entries behind.
+// With the default comparator the top is the smallest (key, id) pair.
+template <typename Key, typename Compare = std::less<Key>, int Arity = 4>
+class IndexedHeap
+{
+public:
+    static constexpr uint32_t npos = UINT32_MAX;
+
+    IndexedHeap() = default;
+
+    explicit IndexedHeap(uint32_t capacity)
+            : keys(capacity)
+            , position(capacity, npos)
+    {}
+
+    [[nodiscard]] bool empty() const
+    {
+        return heap.empty();
+    }
+
+    [[nodiscard]] uint32_t size() const
+    {
+        return heap.size();
+    }
+
+    [[nodiscard]] bool contains(uint32_t id) const
+    {
+        return position[id] != npos;
+    }
+
+    [[nodiscard]] const Key& key(uint32_t id) const
+    {
+        return keys[id];
+    }
+
+    [[nodiscard]] uint32_t top() const
+    {
+        return heap.front();
+    }
+
+    [[nodiscard]] const Key& top_key() const
+    {
+        return keys[heap.front()];
+    }
+
+    // Inserts the id, or moves it to its new place if it is already present
+    void push(uint32_t id, const Key& key)
+    {
+        keys[id] = key;
+        if (contains(id))
+        {
+            sift_up(position[id]);
+            sift_down(position[id]);
+            return;
+        }
+        position[id] = heap.size();
+        heap.push_back(id);
+        sift_up(heap.size() - 1);
+    }
+
+    uint32_t pop()
+    {
+        uint32_t id = heap.front();
+        erase(id);
+        return id;
+    }
+
+    void erase(uint32_t id)
+    {
+        uint32_t index = position[id];
+        position[id] = npos;
+
+        uint32_t last = heap.back();
+        heap.pop_back();
+        if (last == id)
+            return;
+
+        heap[index] = last;
+        position[last] = index;
+        sift_up(index);
+        sift_down(position[last]);
+    }
+
+    void clear()
+    {
+        for (uint32_t id : heap)
+            position[id] = npos;
+        heap.clear();
+    }
+
+private:
+    std::vector<Key> keys;
+    std::vector<uint32_t> position, heap;
+    Compare compare;
+
+    // Strict ordering on (key, id), so equal keys always come out in the same order
+    [[nodiscard]] bool before(uint32_t lhs, uint32_t rhs) const
+    {
+        if (compare(keys[lhs], keys[rhs]))
+            return true;
+        if (compare(keys[rhs], keys[lhs]))
+            return false;
+        return lhs < rhs;
+    }
+
+    void place(uint32_t index, uint32_t id)
+    {
+        heap[index] = id;
+        position[id] = index;
+    }
+
+    void sift_up(uint32_t index)
+    {
+        uint32_t id = heap[index];
+        while (index > 0)
+        {
+            uint32_t parent = (index - 1) / Arity;
+            if (!before(id, heap[parent]))
+                break;
+            place(index, heap[parent]);
+            index = parent;
+        }
+        place(index, id);
+    }
+
+    void sift_down(uint32_t index)
+    {
+        uint32_t id = heap[index];
+        while (true)
+        {
+            uint32_t first_child = index * Arity + 1;
+            if (first_child >= heap.size())
+                break;
+
+            uint32_t best_child = first_child;
+            uint32_t last_child = std::min<uint32_t>(first_child + Arity, heap.size());
+            for (uint32_t child = first_child + 1; child < last_child; ++child)
+                if (before(heap[child], heap[best_child]))
+                    best_child = child;
+
+            if (!before(heap[best_child], id))
+                break;
+            place(index, heap[best_child]);
+            index = best_child;
+        }
+        place(index, id);
+    }
+};
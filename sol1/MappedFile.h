@@ -0,0 +1,118 @@
+#pragma once
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Read-only memory mapping of a whole file. The mapping stays at the same address for the lifetime of the object,
+// moves included, so string_views into it can be handed out freely
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string& filename)
+    {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Cannot open " + filename + ": " + std::strerror(errno));
+
+        struct stat file_stat{};
+        if (fstat(fd, &file_stat) < 0)
+        {
+            close(fd);
+            throw std::runtime_error("Cannot stat " + filename + ": " + std::strerror(errno));
+        }
+
+        length = file_stat.st_size;
+        if (length)
+        {
+            void* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED)
+            {
+                close(fd);
+                throw std::runtime_error("Cannot map " + filename + ": " + std::strerror(errno));
+            }
+            begin = static_cast<const char*>(mapping);
+            // The whole file is parsed front to back right away
+            madvise(mapping, length, MADV_SEQUENTIAL | MADV_WILLNEED);
+        }
+        close(fd);
+    }
+
+    MappedFile(MappedFile&& other) noexcept
+            : begin(other.begin)
+            , length(other.length)
+    {
+        other.begin = nullptr;
+        other.length = 0;
+    }
+
+    MappedFile& operator=(MappedFile&& other) noexcept
+    {
+        std::swap(begin, other.begin);
+        std::swap(length, other.length);
+        return *this;
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile()
+    {
+        if (begin)
+            munmap(const_cast<char*>(begin), length);
+    }
+
+    [[nodiscard]] std::string_view view() const
+    {
+        return {begin, length};
+    }
+
+private:
+    const char* begin = nullptr;
+    size_t length = 0;
+};
+
+// Splits whitespace separated input in place, the tokens are views into the input
+class Tokenizer
+{
+public:
+    explicit Tokenizer(std::string_view input)
+            : cursor(input.data())
+            , end(input.data() + input.size())
+    {}
+
+    std::string_view next_word()
+    {
+        while (cursor < end && is_space(*cursor))
+            ++cursor;
+        const char* start = cursor;
+        while (cursor < end && !is_space(*cursor))
+            ++cursor;
+        return {start, (size_t)(cursor - start)};
+    }
+
+    int next_int()
+    {
+        auto word = next_word();
+        int value = 0;
+        auto [last, error] = std::from_chars(word.data(), word.data() + word.size(), value);
+        if (error != std::errc() || last != word.data() + word.size())
+            throw std::runtime_error("Expected a number, got '" + std::string(word) + "'");
+        return value;
+    }
+
+private:
+    const char* cursor;
+    const char* end;
+
+    static bool is_space(char c)
+    {
+        return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+    }
+};
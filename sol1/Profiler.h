@@ -0,0 +1,348 @@
+#pragma once
+#include <cstdint>
+
+// Counters and scoped timers for the hot paths of the simulation.
+//
+// Everything goes through the PROFILE_* macros below. Unless SOL1_PROFILE is defined (cmake -DSOL1_PROFILE=ON) they
+// expand to nothing, so the instrumentation costs nothing in normal builds.
+//
+// When enabled, every thread writes to its own block of counters and its own list of trace events, so nothing is
+// shared on the hot path. The totals are added up when a stats line is printed, and the events can be written out as a
+// Chrome trace, which chrome://tracing and ui.perfetto.dev both open. Reset and export are meant to be called while no
+// search is running.
+
+enum class ProfilePhase : uint8_t
+{
+    Simulate,
+    AllocateDay,
+    FeasibilityFilter,
+    PortfolioSearch,
+    FindAlloc,
+    RoleMatching,
+    PassDays,
+    UpdateContributors,
+    OptimizeEpoch,
+    Count
+};
+
+enum class ProfileCounter : uint8_t
+{
+    // Projects checked by the feasibility filter, and those it rejected
+    CandidatesChecked,
+    CandidatesFiltered,
+    // Projects the filter let through but a complete search proved infeasible
+    FalsePositives,
+    SearchNodes,
+    SearchTimeouts,
+    SearchesCancelled,
+    // Searches skipped because an earlier failure still holds
+    MemoHits,
+    Allocations,
+    DaysPassed,
+    // Time the scheduler workers spent running tasks or waiting for some
+    WorkerBusyNs,
+    WorkerIdleNs,
+    // Moves the schedule optimizer scored, and those it kept
+    OptimizerMoves,
+    OptimizerAccepted,
+    Count
+};
+
+#ifdef SOL1_PROFILE
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class Profiler
+{
+public:
+    static constexpr size_t MAX_EVENTS_PER_THREAD = 1 << 18;
+    static constexpr std::chrono::seconds STATS_INTERVAL{5};
+
+    static Profiler& instance()
+    {
+        static Profiler profiler;
+        return profiler;
+    }
+
+    // Everything one thread recorded. Only the owning thread writes, other threads read the counters with relaxed loads
+    struct ThreadProfile
+    {
+        uint32_t thread_index;
+        std::string name;
+        std::array<std::atomic<uint64_t>, (size_t)ProfileCounter::Count> counters{};
+        std::array<std::atomic<uint64_t>, (size_t)ProfilePhase::Count> phase_ns{}, phase_calls{};
+
+        struct Event
+        {
+            ProfilePhase phase;
+            uint64_t start_ns, duration_ns;
+        };
+        std::vector<Event> events;
+        uint64_t dropped_events = 0;
+
+        void add(ProfileCounter counter, uint64_t amount)
+        {
+            auto& value = counters[(size_t)counter];
+            value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+        }
+
+        void add_phase(ProfilePhase phase, uint64_t start_ns, uint64_t duration_ns)
+        {
+            auto& total = phase_ns[(size_t)phase];
+            total.store(total.load(std::memory_order_relaxed) + duration_ns, std::memory_order_relaxed);
+            auto& calls = phase_calls[(size_t)phase];
+            calls.store(calls.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+            if (events.size() < MAX_EVENTS_PER_THREAD)
+                events.push_back({phase, start_ns, duration_ns});
+            else
+                dropped_events++;
+        }
+    };
+
+    static ThreadProfile& local()
+    {
+        static thread_local ThreadProfile* profile = instance().register_thread();
+        return *profile;
+    }
+
+    [[nodiscard]] uint64_t now_ns() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    static void set_thread_name(std::string name)
+    {
+        auto& profile = local();
+        std::lock_guard lock(instance().mutex);
+        profile.name = std::move(name);
+    }
+
+    [[nodiscard]] uint64_t total(ProfileCounter counter)
+    {
+        std::lock_guard lock(mutex);
+        uint64_t sum = 0;
+        for (const auto& profile : threads)
+            sum += profile->counters[(size_t)counter].load(std::memory_order_relaxed);
+        return sum;
+    }
+
+    [[nodiscard]] uint64_t total_ns(ProfilePhase phase)
+    {
+        std::lock_guard lock(mutex);
+        uint64_t sum = 0;
+        for (const auto& profile : threads)
+            sum += profile->phase_ns[(size_t)phase].load(std::memory_order_relaxed);
+        return sum;
+    }
+
+    void print_stats(std::ostream& out, int day)
+    {
+        using enum ProfileCounter;
+        uint64_t busy = total(WorkerBusyNs), idle = total(WorkerIdleNs);
+        out << "[stats] t=" << now_ns() / 1'000'000 << "ms day=" << day
+            << " allocations=" << total(Allocations)
+            << " days_passed=" << total(DaysPassed)
+            << " candidates=" << total(CandidatesChecked)
+            << " filtered=" << total(CandidatesFiltered)
+            << " false_positives=" << total(FalsePositives)
+            << " nodes=" << total(SearchNodes)
+            << " timeouts=" << total(SearchTimeouts)
+            << " cancelled=" << total(SearchesCancelled)
+            << " memo_hits=" << total(MemoHits)
+            << " optimizer_moves=" << total(OptimizerMoves)
+            << " filter_ms=" << total_ns(ProfilePhase::FeasibilityFilter) / 1'000'000
+            << " search_ms=" << total_ns(ProfilePhase::PortfolioSearch) / 1'000'000
+            << " pass_days_ms=" << total_ns(ProfilePhase::PassDays) / 1'000'000
+            << " worker_busy=" << (busy + idle ? 100 * busy / (busy + idle) : 0) << "%\n";
+        record_counter_sample();
+    }
+
+    // Prints a stats line if the last one is older than STATS_INTERVAL
+    void maybe_print_stats(std::ostream& out, int day)
+    {
+        uint64_t now = now_ns(), last = last_stats_ns.load(std::memory_order_relaxed);
+        if (now - last < (uint64_t)std::chrono::nanoseconds(STATS_INTERVAL).count())
+            return;
+        // Simulations running side by side take turns
+        if (!last_stats_ns.compare_exchange_strong(last, now, std::memory_order_relaxed))
+            return;
+        print_stats(out, day);
+    }
+
+    void write_chrome_trace(const std::string& filename)
+    {
+        std::lock_guard lock(mutex);
+        std::ofstream out(filename);
+        out << std::fixed << std::setprecision(3);
+        out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        bool first = true;
+        auto separator = [&](){
+            out << (first ? "" : ",\n");
+            first = false;
+        };
+
+        for (const auto& profile : threads)
+        {
+            separator();
+            out << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << profile->thread_index
+                << ", \"args\": {\"name\": \"" << profile->name << "\"}}";
+            for (const auto& event : profile->events)
+            {
+                separator();
+                out << "{\"name\": \"" << phase_name(event.phase) << "\", \"cat\": \"sol1\", \"ph\": \"X\", \"pid\": 1, "
+                    << "\"tid\": " << profile->thread_index << ", \"ts\": " << event.start_ns / 1000.0
+                    << ", \"dur\": " << event.duration_ns / 1000.0 << "}";
+            }
+            if (profile->dropped_events)
+            {
+                separator();
+                out << "{\"name\": \"dropped " << profile->dropped_events << " events\", \"ph\": \"i\", \"s\": \"t\", "
+                    << "\"pid\": 1, \"tid\": " << profile->thread_index << ", \"ts\": 0}";
+            }
+        }
+
+        for (const auto& [timestamp_ns, values] : counter_samples)
+            for (size_t counter = 0; counter < values.size(); ++counter)
+            {
+                separator();
+                out << "{\"name\": \"" << counter_name((ProfileCounter)counter) << "\", \"ph\": \"C\", \"pid\": 1, "
+                    << "\"ts\": " << timestamp_ns / 1000.0 << ", \"args\": {\"value\": " << values[counter] << "}}";
+            }
+        out << "\n]}\n";
+    }
+
+    // Starts over, for instance between two inputs
+    void reset()
+    {
+        std::lock_guard lock(mutex);
+        epoch = std::chrono::steady_clock::now();
+        last_stats_ns = 0;
+        counter_samples.clear();
+        for (auto& profile : threads)
+        {
+            for (auto& value : profile->counters)
+                value.store(0, std::memory_order_relaxed);
+            for (auto& value : profile->phase_ns)
+                value.store(0, std::memory_order_relaxed);
+            for (auto& value : profile->phase_calls)
+                value.store(0, std::memory_order_relaxed);
+            profile->events.clear();
+            profile->dropped_events = 0;
+        }
+    }
+
+    static const char* phase_name(ProfilePhase phase)
+    {
+        static constexpr const char* names[] = {"Simulate", "AllocateDay", "FeasibilityFilter", "PortfolioSearch",
+                                                "FindAlloc", "RoleMatching", "PassDays", "UpdateContributors",
+                                                "OptimizeEpoch"};
+        return names[(size_t)phase];
+    }
+
+    static const char* counter_name(ProfileCounter counter)
+    {
+        static constexpr const char* names[] = {"CandidatesChecked", "CandidatesFiltered", "FalsePositives", "SearchNodes",
+                                                "SearchTimeouts", "SearchesCancelled", "MemoHits", "Allocations", "DaysPassed",
+                                                "WorkerBusyNs", "WorkerIdleNs", "OptimizerMoves", "OptimizerAccepted"};
+        return names[(size_t)counter];
+    }
+
+    // Adds the time spent in its scope to a phase, and records it as a trace event
+    class Scope
+    {
+    public:
+        explicit Scope(ProfilePhase phase)
+                : phase(phase)
+                , start_ns(instance().now_ns())
+        {}
+
+        ~Scope()
+        {
+            local().add_phase(phase, start_ns, instance().now_ns() - start_ns);
+        }
+
+    private:
+        ProfilePhase phase;
+        uint64_t start_ns;
+    };
+
+    // Adds the time spent in its scope to a counter, without a trace event
+    class CounterScope
+    {
+    public:
+        explicit CounterScope(ProfileCounter counter)
+                : counter(counter)
+                , start_ns(instance().now_ns())
+        {}
+
+        ~CounterScope()
+        {
+            local().add(counter, instance().now_ns() - start_ns);
+        }
+
+    private:
+        ProfileCounter counter;
+        uint64_t start_ns;
+    };
+
+private:
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadProfile>> threads;
+    std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    std::atomic<uint64_t> last_stats_ns = 0;
+    std::vector<std::pair<uint64_t, std::array<uint64_t, (size_t)ProfileCounter::Count>>> counter_samples;
+
+    ThreadProfile* register_thread()
+    {
+        std::lock_guard lock(mutex);
+        auto& profile = threads.emplace_back(std::make_unique<ThreadProfile>());
+        profile->thread_index = threads.size() - 1;
+        profile->name = "thread " + std::to_string(profile->thread_index);
+        profile->events.reserve(1024);
+        return profile.get();
+    }
+
+    void record_counter_sample()
+    {
+        std::array<uint64_t, (size_t)ProfileCounter::Count> values{};
+        for (size_t counter = 0; counter < values.size(); ++counter)
+            values[counter] = total((ProfileCounter)counter);
+        std::lock_guard lock(mutex);
+        counter_samples.emplace_back(now_ns(), values);
+    }
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(phase) Profiler::Scope PROFILE_CONCAT(profile_scope_, __LINE__)(ProfilePhase::phase)
+#define PROFILE_TIME_INTO(counter) \
+    Profiler::CounterScope PROFILE_CONCAT(profile_counter_scope_, __LINE__)(ProfileCounter::counter)
+#define PROFILE_COUNT(counter, amount) Profiler::local().add(ProfileCounter::counter, (amount))
+#define PROFILE_THREAD_NAME(name) Profiler::set_thread_name(name)
+#define PROFILE_PERIODIC_STATS(out, day) Profiler::instance().maybe_print_stats(out, day)
+#define PROFILE_FINAL_STATS(out, day) Profiler::instance().print_stats(out, day)
+#define PROFILE_WRITE_TRACE(filename) Profiler::instance().write_chrome_trace(filename)
+#define PROFILE_RESET() Profiler::instance().reset()
+
+#else
+
+#define PROFILE_SCOPE(phase) ((void)0)
+#define PROFILE_TIME_INTO(counter) ((void)0)
+#define PROFILE_COUNT(counter, amount) ((void)0)
+#define PROFILE_THREAD_NAME(name) ((void)0)
+#define PROFILE_PERIODIC_STATS(out, day) ((void)0)
+#define PROFILE_FINAL_STATS(out, day) ((void)0)
+#define PROFILE_WRITE_TRACE(filename) ((void)0)
+#define PROFILE_RESET() ((void)0)
+
+#endif
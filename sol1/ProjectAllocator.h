@@ -1,245 +1,534 @@
 #pragma once
 
-#include <omp.h>
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <queue>
 #include <random>
+#include <string>
 #include <algorithm>
-#include <functional>
+#include <bit>
+#include <optional>
 
+#include "Profiler.h"
+#include "RoleMatcher.h"
+#include "SearchResult.h"
 #include "SimulationState.h"
+#include "TaskScheduler.h"
+#include "TimeBudget.h"
 
 using namespace std::chrono;
 
-using SkillToLevel = std::pair<std::string, int>;
-using WeightedAllocation = std::pair<int, std::vector<std::string>>;
+enum class SearchEngine
+{
+    // Randomized backtracking, several shuffles raced against each other
+    Backtracking,
+    // Constraint propagating role matcher, see RoleMatcher.h
+    RoleMatching
+};
+
+// What the portfolio waits for before handing back the allocation of a project
+enum class PortfolioPolicy
+{
+    // The first allocation any variant finds, the other variants are cancelled right away. The default
+    FirstFound,
+    // The allocation with the most learning points found by the variants before the deadline. Unless one of them
+    // levels up every role, the others run until they are done or time out, which can take the whole time limit
+    MostLearning
+};
+
+// The engine and policy names of the --engine and --policy options
+inline bool parse_search_engine(const std::string& name, SearchEngine& engine)
+{
+    if (name == "backtracking")
+        engine = SearchEngine::Backtracking;
+    else if (name == "matcher")
+        engine = SearchEngine::RoleMatching;
+    else
+        return false;
+    return true;
+}
 
+inline bool parse_portfolio_policy(const std::string& name, PortfolioPolicy& policy)
+{
+    if (name == "first")
+        policy = PortfolioPolicy::FirstFound;
+    else if (name == "learning")
+        policy = PortfolioPolicy::MostLearning;
+    else
+        return false;
+    return true;
+}
 
-class ProjectAllocator
+struct PortfolioOptions
 {
-public:
-    static std::vector<std::pair<SkillToLevel, int>> get_shuffled_roles(const std::vector<SkillToLevel>& project_roles)
+    SearchEngine search_engine = SearchEngine::Backtracking;
+    PortfolioPolicy policy = PortfolioPolicy::FirstFound;
+    // Differently shuffled backtracking searches per project, the role matcher always runs once
+    int nr_variants = 10;
+    // Top candidates from the project queue evaluated together
+    int candidates_in_flight = 1;
+    // Deadline for the whole batch of candidates, and the most any search gets in the anytime mode
+    steady_clock::duration time_limit = seconds(15);
+    // Anytime mode: one budget for the whole simulation, split over the searches, see TimeBudget.h
+    std::optional<TimeBudget> budget;
+    // Makes the role shuffles reproducible, unset draws them from std::random_device
+    std::optional<uint64_t> seed;
+
+    // Spreads the workers of the scheduler over variants and candidates
+    static PortfolioOptions sized_to(const TaskScheduler& scheduler, SearchEngine search_engine, PortfolioPolicy policy)
     {
-        // Tie the roles to their original index so that we can reconstruct the solution later
-        std::vector<std::pair<SkillToLevel, int>> roles_to_original_index;
-        for (int index = 0; index < project_roles.size(); ++index)
-            roles_to_original_index.emplace_back(project_roles[index], index);
-
-        // Shuffle the array
-        std::random_device rd;
-        std::mt19937 g(rd());
-        std::shuffle(roles_to_original_index.begin(), roles_to_original_index.end(), g);
-        return roles_to_original_index;
+        PortfolioOptions options;
+        options.search_engine = search_engine;
+        options.policy = policy;
+        int nr_workers = scheduler.size();
+        options.candidates_in_flight = std::max(1, nr_workers / options.variants_per_project());
+        return options;
     }
 
-    static bool could_role_be_theoretically_mentored(const SimulationState& simulation_state,
-                                                     std::vector<std::pair<SkillToLevel, int>>& roles_to_original_index,
-                                                     const std::vector<std::string>& role_to_contr,
-                                                     const SkillToLevel& role,
-                                                     int current_step)
+    [[nodiscard]] int variants_per_project() const
     {
-        // can be mentored if someone in a different role has curr_skill >= level_req
+        return search_engine == SearchEngine::RoleMatching ? 1 : std::max(1, nr_variants);
+    }
+};
 
-        auto contributor_has_skill_at_level = [&simulation_state](const std::string& contr_name, const std::string& skill, int level_req){
-            const auto& contr_per_levels = simulation_state.skill_to_contributors.find(skill)->second;
-            for (int level = level_req; level <= 20; ++level)
-                if (contr_per_levels[level].contains(contr_name))
-                    return true;
-            return false;
-        };
+// Per-role state of a search: N entries on the stack, or for N == 0 any number of them on the heap
+template <typename T, int N>
+struct RoleArray : std::array<T, N>
+{
+    explicit RoleArray(size_t, const T& value = {})
+    {
+        this->fill(value);
+    }
+};
 
-        // Check if contributors chosen so far can mentor
-        for (int step = 0; step < current_step; ++step)
-        {
-            const auto& [colleague_skill, _] = roles_to_original_index[step].first;
+template <typename T>
+struct RoleArray<T, 0> : std::vector<T>
+{
+    explicit RoleArray(size_t size, const T& value = {})
+            : std::vector<T>(size, value)
+    {}
+};
 
-            // Do the colleagues selected so far have the role skill at the required level?
-            const auto& contr_per_levels = simulation_state.skill_to_contributors.find(role.first)->second;
-            for (int level = role.second; level <= 20; ++level)
-                if (contr_per_levels[level].contains(role_to_contr[step]))
-                    return true;
-        }
+class ProjectAllocator
+{
+public:
+    // Ties every role to its original index, so that the solution can be reconstructed later, and shuffles them
+    static void shuffle_roles(std::span<const SkillToLevel> project_roles, uint64_t seed,
+                              std::span<std::pair<SkillToLevel, int>> roles_to_original_index)
+    {
+        for (int index = 0; index < project_roles.size(); ++index)
+            roles_to_original_index[index] = {project_roles[index], index};
 
-        // None of the colleagues selected so far are able to mentor this skill, check other available contributors
-        // who could fulfill other roles in this project
+        std::mt19937_64 g(seed);
+        std::shuffle(roles_to_original_index.begin(), roles_to_original_index.end(), g);
+    }
 
+    // Whether someone available who could fill one of the roles after current_step could mentor the role. Does not
+    // depend on the contributors chosen so far
+    static bool could_later_role_mentor(const SimulationState& simulation_state,
+                                        std::span<const std::pair<SkillToLevel, int>> roles_to_original_index,
+                                        const SkillToLevel& role,
+                                        int current_step)
+    {
+        const auto& skill_matrix = simulation_state.skill_matrix;
+        const auto& possible_mentors = skill_matrix.contributors_at_least(role.first, role.second);
         for (int step = current_step + 1; step < roles_to_original_index.size(); ++step)
         {
             const auto& [curr_skill, level_req] = roles_to_original_index[step].first;
-            const auto& contr_per_levels = simulation_state.skill_to_contributors.find(curr_skill)->second;
 
             // The mentor could also be mentored
-            for (int level = level_req - 1; level <= 20; ++level)
-            {
-                for (const auto& contr: contr_per_levels[level])
-                {
-                    int contr_available_at = (simulation_state.available_at.find(contr)->second);
-                    // Could mentor the role skill
-                    if (contr_available_at <= simulation_state.day && contributor_has_skill_at_level(contr, role.first, role.second))
-                        return true;
-                }
-            }
+            if (Bitset::intersects(skill_matrix.contributors_at_least(curr_skill, level_req - 1),
+                                   possible_mentors,
+                                   simulation_state.available))
+                return true;
         }
         return false;
     }
 
-    static WeightedAllocation find_alloc(const SimulationState& simulation_state,
-                                         const std::vector<SkillToLevel>& project_roles,
-                                         bool skip_mentoring)
+    // Backtracking search for an allocation of the project, see find_alloc_kernel. Projects of up to 8 roles, most of
+    // them on every input, go to the kernel specialized on their role count
+    static SearchResult find_alloc(const SimulationState& simulation_state,
+                                   std::span<const SkillToLevel> project_roles,
+                                   bool skip_mentoring,
+                                   const SearchLimits& limits = {},
+                                   uint64_t seed = std::random_device{}())
+    {
+        PROFILE_SCOPE(FindAlloc);
+        switch (project_roles.size())
+        {
+            case 1: return find_alloc_kernel<1>(simulation_state, project_roles, skip_mentoring, limits, seed);
+            case 2: return find_alloc_kernel<2>(simulation_state, project_roles, skip_mentoring, limits, seed);
+            case 3: return find_alloc_kernel<3>(simulation_state, project_roles, skip_mentoring, limits, seed);
+            case 4: return find_alloc_kernel<4>(simulation_state, project_roles, skip_mentoring, limits, seed);
+            case 5: return find_alloc_kernel<5>(simulation_state, project_roles, skip_mentoring, limits, seed);
+            case 6: return find_alloc_kernel<6>(simulation_state, project_roles, skip_mentoring, limits, seed);
+            case 7: return find_alloc_kernel<7>(simulation_state, project_roles, skip_mentoring, limits, seed);
+            case 8: return find_alloc_kernel<8>(simulation_state, project_roles, skip_mentoring, limits, seed);
+            default: return find_alloc_kernel<0>(simulation_state, project_roles, skip_mentoring, limits, seed);
+        }
+    }
+
+    // Iterative backtracking over the shuffled roles. Every step walks the candidate levels from level_req - 1
+    // (or level_req when skipping mentoring) up to MAX_LEVEL, and the available contributors of each level in id
+    // order. The clock is only read every few thousand nodes.
+    //
+    // NrRoles is the number of roles of the project, or 0 for any number. With a fixed count all the search state is
+    // in arrays on the stack and the role loops have constant bounds. The contributors already chosen are then masked
+    // out of a word by comparing against the few chosen ids, instead of keeping a bitset over all the contributors
+    // that every search would have to allocate and clear. Both versions explore the same nodes in the same order
+    template <int NrRoles>
+    static SearchResult find_alloc_kernel(const SimulationState& simulation_state,
+                                          std::span<const SkillToLevel> project_roles,
+                                          bool skip_mentoring,
+                                          const SearchLimits& limits,
+                                          uint64_t seed)
     {
-        auto roles_to_original_index = get_shuffled_roles(project_roles);
-        std::map<std::string, bool> contr_already_chosen;
-        std::vector<std::string> role_to_contr(project_roles.size()), valid_solution(project_roles.size());
-        int solution_points = 0;
-        bool solution_found = false;
+        constexpr uint64_t DEADLINE_CHECK_INTERVAL = 4096;
+        const auto& skill_matrix = simulation_state.skill_matrix;
+        const auto& available = simulation_state.available;
+        const int nr_roles = NrRoles ? NrRoles : (int)project_roles.size();
+        const uint32_t nr_words = available.nr_words();
+
+        // The available contributors who could fill a step, word by word from its first level up, leaving out the
+        // levels and words that have none. Nobody becomes available during the search, so the words of a step are
+        // collected the first time the search gets to it, and the steps are first reached in order. The buffer is
+        // reserved for every step up front, so nothing is allocated once the search runs
+        struct CandidateWord
+        {
+            int level;
+            uint32_t word_index;
+            uint64_t contributors;
+        };
+        std::vector<CandidateWord> candidate_words;
+        RoleArray<std::pair<uint32_t, uint32_t>, NrRoles> word_range(nr_roles);
+        int nr_steps_collected = 0;
 
+        // Where the search currently is for every step: the next of its candidate words, the level being explored
+        // and whether it is usable, and the candidates of the current word that are still to be tried
+        struct Frame
+        {
+            uint32_t next_word;
+            int level;
+            bool level_usable;
+            uint32_t word_index;
+            uint64_t candidates;
+        };
+        RoleArray<std::pair<SkillToLevel, int>, NrRoles> roles_to_original_index(nr_roles);
+        RoleArray<Frame, NrRoles> frames(nr_roles);
+        RoleArray<uint32_t, NrRoles> role_to_contr(nr_roles, Bitset::npos);
+        // could_later_role_mentor for every step, -1 until needed
+        RoleArray<int8_t, NrRoles> later_role_can_mentor(nr_roles, -1);
+        // Only the generic version keeps the chosen contributors in a bitset
+        Bitset contr_already_chosen(NrRoles ? 0 : simulation_state.data.nr_contributors);
+
+        shuffle_roles(project_roles, seed, roles_to_original_index);
+
+        auto first_level = [&](int step){
+            return roles_to_original_index[step].first.second - 1 + skip_mentoring;
+        };
+
+        // Level 0 has at most a word per word of contributors, and every word of a higher level holds at least one
+        // of the skilled contributors
+        size_t max_candidate_words = 0;
+        for (int step = 0; step < nr_roles; ++step)
+        {
+            const auto curr_skill = roles_to_original_index[step].first.first;
+            if (first_level(step) == 0)
+                max_candidate_words += nr_words;
+            max_candidate_words += std::min<size_t>(skill_matrix.skilled_contributors(curr_skill).size(),
+                                                    (size_t)nr_words * MAX_LEVEL);
+        }
+        candidate_words.reserve(max_candidate_words);
+
+        SearchResult result;
         auto start = steady_clock::now();
-        auto is_timer_expired = [&start](){
-            auto now = steady_clock::now();
-            auto elapsed = duration_cast<seconds>(now - start);
-            return elapsed.count() >= 15;
+        auto deadline = start + limits.time_limit;
+
+        auto enter_step = [&](int step){
+            if (step == nr_steps_collected)
+            {
+                const auto curr_skill = roles_to_original_index[step].first.first;
+                word_range[step].first = candidate_words.size();
+                for (int level = first_level(step); level <= MAX_LEVEL; ++level)
+                    for (uint32_t word_index = skill_matrix.next_word_at(curr_skill, level, 0); word_index < nr_words;
+                         word_index = skill_matrix.next_word_at(curr_skill, level, word_index + 1))
+                        if (uint64_t contributors = skill_matrix.word_at(curr_skill, level, word_index) & available.data()[word_index])
+                            candidate_words.push_back({level, word_index, contributors});
+                word_range[step].second = candidate_words.size();
+                ++nr_steps_collected;
+            }
+            frames[step] = {word_range[step].first, -1, false, 0, 0};
+        };
+
+        // A level is only worth exploring for this step if its contributors could do the role, at level_req - 1 if
+        // someone could mentor them: a colleague chosen so far, or someone available for one of the later roles
+        auto is_level_usable = [&](int step, int level){
+            const auto& role = roles_to_original_index[step].first;
+            if (level != role.second - 1)
+                return true;
+            for (int other = 0; other < step; ++other)
+                if (skill_matrix.has_skill_at_level(role_to_contr[other], role.first, role.second))
+                    return true;
+            if (later_role_can_mentor[step] < 0)
+                later_role_can_mentor[step] = could_later_role_mentor(simulation_state, roles_to_original_index, role, step);
+            return later_role_can_mentor[step] == 1;
+        };
+
+        // Contributors of this word chosen by the steps before this one
+        auto chosen_in_word = [&](int step, uint32_t word_index) -> uint64_t {
+            if constexpr (NrRoles == 0)
+                return contr_already_chosen.data()[word_index];
+            uint64_t chosen = 0;
+            for (int other = 0; other < NrRoles; ++other)
+                if (other < step && role_to_contr[other] >> 6 == word_index)
+                    chosen |= uint64_t(1) << (role_to_contr[other] & 63);
+            return chosen;
         };
 
-        std::function<void(int)> find_allocation_backtracking = [&](int step){
-            if (step == project_roles.size())
+        auto mentoring_is_valid = [&](int& learning_points){
+            learning_points = 0;
+            for (int role_index = 0; role_index < nr_roles; ++role_index)
             {
-                bool is_solution_valid = true;
-                int learning_points = 0;
+                const auto& [curr_skill, level_req] = roles_to_original_index[role_index].first;
+
+                if (skill_matrix.level(role_to_contr[role_index], curr_skill) != level_req - 1)
+                    continue;
 
-                for (int role_index = 0; role_index < project_roles.size(); ++role_index)
+                bool can_others_mentor = false;
+                for (int other = 0; other < nr_roles && !can_others_mentor; ++other)
+                    can_others_mentor = skill_matrix.has_skill_at_level(role_to_contr[other], curr_skill, level_req);
+                if (!can_others_mentor)
+                    return false;
+                learning_points++;
+            }
+            return true;
+        };
+
+        int step = 0;
+        enter_step(0);
+        while (step >= 0)
+        {
+            if ((++result.nodes % DEADLINE_CHECK_INTERVAL) == 0)
+            {
+                if (limits.is_cancelled())
                 {
-                    const auto& [curr_skill, level_req] = roles_to_original_index[role_index].first;
-                    const auto& contr_for_role = role_to_contr[role_index];
-                    const auto& contr_per_levels = simulation_state.skill_to_contributors.find(curr_skill)->second;
-
-                    auto can_others_mentor = [&contr_per_levels, &role_to_contr, level_req](){
-                        for (const auto& contr_name: role_to_contr)
-                            for (int level = level_req; level <= 20; ++level)
-                                if (contr_per_levels[level].contains(contr_name))
-                                    return true;
-                        return false;
-                    };
-
-                    auto needs_mentorship = [&contr_per_levels, level_req](const std::string& contr_name){
-                        return contr_per_levels[level_req - 1].contains(contr_name);
-                    };
-
-                    if (needs_mentorship(contr_for_role))
-                    {
-                        if (can_others_mentor())
-                            learning_points++;
-                        else
-                        {
-                            is_solution_valid = false;
-                            break;
-                        }
-                    }
+                    result.status = SearchResult::Status::Cancelled;
+                    break;
                 }
-                if (is_solution_valid)
+                if (steady_clock::now() >= deadline)
                 {
-                    solution_points = learning_points;
-                    valid_solution = role_to_contr;
-                    solution_found = true;
+                    result.status = SearchResult::Status::TimedOut;
+                    break;
                 }
             }
-            else
+
+            auto& frame = frames[step];
+
+            // Give back the contributor tried last at this step
+            if (role_to_contr[step] != Bitset::npos)
             {
-                const auto& [curr_skill, level_req] = roles_to_original_index[step].first;
-                // For skill between [level_req - 1, max)
-                for (int contr_level = level_req - 1 + skip_mentoring; contr_level <= 20; ++contr_level)
-                {
-                    if (contr_level == level_req - 1 && !could_role_be_theoretically_mentored(simulation_state,
-                                                                                              roles_to_original_index,
-                                                                                              role_to_contr,
-                                                                                              roles_to_original_index[step].first,
-                                                                                              step))
-                        continue;
-
-                    const auto& contr_per_levels = simulation_state.skill_to_contributors.find(curr_skill)->second;
-                    // Going over all contributors with skill == contr_level
-                    for (const auto &contr_name: contr_per_levels[contr_level])
-                    {
-                        if (is_timer_expired() || solution_found)
-                            break;
+                if constexpr (NrRoles == 0)
+                    contr_already_chosen.reset(role_to_contr[step]);
+                role_to_contr[step] = Bitset::npos;
+            }
 
-                        // Skip already chosen/busy contributors
-                        int contr_available_at = (simulation_state.available_at.find(contr_name)->second);
-                        if (contr_already_chosen[contr_name] || contr_available_at > simulation_state.day)
-                            continue;
+            // Move on to the next available, not yet chosen contributor
+            while (!frame.candidates && frame.next_word < word_range[step].second)
+            {
+                const auto& [level, word_index, contributors] = candidate_words[frame.next_word++];
+                if (level != frame.level)
+                {
+                    frame.level = level;
+                    frame.level_usable = is_level_usable(step, level);
+                }
+                if (!frame.level_usable)
+                    continue;
+                frame.word_index = word_index;
+                frame.candidates = contributors & ~chosen_in_word(step, word_index);
+            }
 
-                        contr_already_chosen[contr_name] = true;
-                        role_to_contr[step] = contr_name;
+            // Out of candidates, backtrack
+            if (!frame.candidates)
+            {
+                --step;
+                continue;
+            }
 
-                        find_allocation_backtracking(step + 1);
+            uint32_t contr_id = (frame.word_index << 6) | std::countr_zero(frame.candidates);
+            frame.candidates &= frame.candidates - 1;
+            if constexpr (NrRoles == 0)
+                contr_already_chosen.set(contr_id);
+            role_to_contr[step] = contr_id;
 
-                        contr_already_chosen[contr_name] = false;
-                    }
-                    if (is_timer_expired() || solution_found)
-                        break;
+            if (step + 1 == nr_roles)
+            {
+                if (mentoring_is_valid(result.learning_points))
+                {
+                    result.status = SearchResult::Status::Found;
+                    break;
                 }
+                // Stay on this step and try the next contributor
+                continue;
             }
-        };
-        find_allocation_backtracking(0);
 
-        // No solution found in a reasonable timeframe
-        if (!solution_found)
-            return {0, {}};
+            ++step;
+            enter_step(step);
+        }
+        result.seconds = duration<double>(steady_clock::now() - start).count();
+
+        if (!result.found())
+            return result;
 
         // Formatting the solution
-        std::vector<std::string> solution_in_order(project_roles.size());
-        for (int index_in_shuffled = 0; index_in_shuffled < project_roles.size(); ++index_in_shuffled)
+        result.contributor_ids.resize(nr_roles);
+        for (int index_in_shuffled = 0; index_in_shuffled < nr_roles; ++index_in_shuffled)
         {
             const auto& [skill_to_level, original_index] = roles_to_original_index[index_in_shuffled];
-
-            solution_in_order[original_index] = valid_solution[index_in_shuffled];
+            result.contributor_ids[original_index] = role_to_contr[index_in_shuffled];
         }
-
-        return {solution_points, solution_in_order};
+        return result;
     }
 
-    static WeightedAllocation find_allocation_for_project(const SimulationState& simulation_state, const Project& project)
+    // Searches allocations for several projects at once on the shared scheduler, the projects being given from the
+    // highest priority down. Every project gets a portfolio of variants, and a search is cancelled as soon as its
+    // result can no longer matter: once a higher priority project got an allocation, once a complete variant proved
+    // that the project cannot be done, or, depending on the policy, once a sibling variant found an allocation.
+    // Returns one result per project, the node and second counts adding up all of its variants. time_limits, if given,
+    // replaces the time limit of the options with one per project
+    static std::vector<SearchResult> find_allocations_for_projects(const SimulationState& simulation_state,
+                                                                   const std::vector<int>& project_indices,
+                                                                   const PortfolioOptions& options,
+                                                                   const std::vector<steady_clock::duration>& time_limits = {})
     {
-        std::vector<std::pair<std::string, int>> skill_to_level;
-        for (const auto& [skill_name, level_req] : project.skill_to_level)
-            skill_to_level.emplace_back(skill_name, level_req);
+        PROFILE_SCOPE(PortfolioSearch);
+        const int nr_projects = project_indices.size();
+        const int nr_variants = options.variants_per_project();
+        const auto start = steady_clock::now();
+
+        std::vector<SearchResult> variant_results(nr_projects * nr_variants);
+        std::vector<std::atomic<bool>> cancelled(nr_projects);
+        // Variants that exhausted their search space without skipping anything, per project
+        std::vector<std::atomic<bool>> proven_infeasible(nr_projects);
+
+        TaskGroup group;
+        for (int candidate = 0; candidate < nr_projects; ++candidate)
+            for (int variant = 0; variant < nr_variants; ++variant)
+                group.run([&, candidate, variant](){
+                    auto& result = variant_results[candidate * nr_variants + variant];
+                    if (cancelled[candidate].load(std::memory_order_relaxed))
+                    {
+                        result.status = SearchResult::Status::Cancelled;
+                        return;
+                    }
+                    auto deadline = start + (time_limits.empty() ? options.time_limit : time_limits[candidate]);
+                    auto remaining = deadline - steady_clock::now();
+                    if (remaining <= steady_clock::duration::zero())
+                    {
+                        result.status = SearchResult::Status::TimedOut;
+                        return;
+                    }
+
+                    const auto roles = simulation_state.data.projects.roles(project_indices[candidate]);
+                    SearchLimits limits{remaining, &cancelled[candidate]};
+                    bool complete = true;
+                    if (options.search_engine == SearchEngine::RoleMatching)
+                        result = RoleMatcher::find_alloc(simulation_state, roles, limits);
+                    else
+                    {
+                        // One variant in three only considers contributors who need no mentoring
+                        bool skip_mentoring = (variant % 3) == 2;
+                        complete = !skip_mentoring;
+                        uint64_t seed = options.seed ? search_seed(*options.seed, project_indices[candidate], variant,
+                                                                   simulation_state.day)
+                                                     : std::random_device{}();
+                        result = find_alloc(simulation_state, roles, skip_mentoring, limits, seed);
+                    }
+                    PROFILE_COUNT(SearchNodes, result.nodes);
+                    PROFILE_COUNT(SearchTimeouts, result.status == SearchResult::Status::TimedOut);
+                    PROFILE_COUNT(SearchesCancelled, result.status == SearchResult::Status::Cancelled);
 
-        WeightedAllocation results[10];
-        WeightedAllocation best_allocation = {0, {}};
+                    if (result.found())
+                    {
+                        // The caller takes the first allocation in priority order, lower priority projects are moot
+                        for (int other = candidate + 1; other < nr_projects; ++other)
+                            cancelled[other].store(true, std::memory_order_relaxed);
+                        if (options.policy == PortfolioPolicy::FirstFound || result.learning_points == (int)roles.size())
+                            cancelled[candidate].store(true, std::memory_order_relaxed);
+                    }
+                    else if (complete && result.status == SearchResult::Status::Exhausted)
+                    {
+                        proven_infeasible[candidate].store(true, std::memory_order_relaxed);
+                        cancelled[candidate].store(true, std::memory_order_relaxed);
+                    }
+                });
+        group.wait();
 
-        omp_set_num_threads(10);
-        #pragma omp parallel for
-        for (int th_index = 0; th_index < 10; ++th_index)
-        {
-            bool skip_mentoring = ((th_index % 3) == 0);
-            results[th_index] = find_alloc(simulation_state, skill_to_level, skip_mentoring);
-        }
-        for (int th_index = 0; th_index < 10; ++th_index)
+        std::vector<SearchResult> results(nr_projects);
+        for (int candidate = 0; candidate < nr_projects; ++candidate)
         {
-            const auto& [learning_points, allocation] = results[th_index];
-            if (!allocation.empty() && learning_points >= best_allocation.first)
-                best_allocation = results[th_index];
+            auto& best_result = results[candidate];
+            bool timed_out = false, was_cancelled = false;
+            uint64_t total_nodes = 0;
+            double total_seconds = 0;
+            for (int variant = 0; variant < nr_variants; ++variant)
+            {
+                auto& result = variant_results[candidate * nr_variants + variant];
+                total_nodes += result.nodes;
+                total_seconds += result.seconds;
+                timed_out |= result.status == SearchResult::Status::TimedOut;
+                was_cancelled |= result.status == SearchResult::Status::Cancelled;
+                if (result.found() && (!best_result.found() || result.learning_points > best_result.learning_points))
+                    best_result = std::move(result);
+            }
+
+            if (!best_result.found())
+            {
+                if (proven_infeasible[candidate])
+                    best_result.status = SearchResult::Status::Exhausted;
+                else if (timed_out)
+                    best_result.status = SearchResult::Status::TimedOut;
+                else if (was_cancelled)
+                    best_result.status = SearchResult::Status::Cancelled;
+            }
+            best_result.nodes = total_nodes;
+            best_result.seconds = total_seconds;
         }
+        return results;
+    }
 
-        return best_allocation;
+    static SearchResult find_allocation_for_project(const SimulationState& simulation_state,
+                                                    int project_index,
+                                                    const PortfolioOptions& options = {})
+    {
+        return find_allocations_for_projects(simulation_state, {project_index}, options).front();
     }
 
     static void update_contributors(const Data& data, SimulationState& simulation_state, const ProjectAllocation& project_allocation)
     {
-        const auto& [project_id, contributor_names] = project_allocation;
-        const auto& project = data.projects[project_id];
+        PROFILE_SCOPE(UpdateContributors);
+        const auto& [project_id, contributor_ids] = project_allocation;
+        const auto roles = data.projects.roles(project_id);
 
         int role_id = 0;
-        for (const auto& name : contributor_names)
+        for (const auto& contr_id : contributor_ids)
         {
-            const auto& [role_name, skill_req] = project.skill_to_level[role_id];
-            auto& contr_per_levels = simulation_state.skill_to_contributors.find(role_name)->second;
-
-            if (contr_per_levels[skill_req - 1].contains(name))
-            {
-                contr_per_levels[skill_req - 1].erase(name);
-                contr_per_levels[skill_req].insert(name);
-            }
+            const auto& [role_skill, skill_req] = roles[role_id];
+            // Mentored contributors level up, the bitsets are kept in sync by the matrix
+            if (simulation_state.skill_matrix.level(contr_id, role_skill) == skill_req - 1)
+                simulation_state.level_up(contr_id, role_skill);
             role_id++;
         }
     }
-};
\ No newline at end of file
+
+private:
+    // Seed of one variant of one project on one day, so that a seeded run makes the same choices every time
+    static uint64_t search_seed(uint64_t seed, int project_index, int variant, int day)
+    {
+        // splitmix64 finalizer
+        uint64_t mixed = seed ^ ((uint64_t)project_index << 40) ^ ((uint64_t)variant << 32) ^ (uint32_t)day;
+        mixed = (mixed ^ (mixed >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        mixed = (mixed ^ (mixed >> 27)) * 0x94d049bb133111ebULL;
+        return mixed ^ (mixed >> 31);
+    }
+};
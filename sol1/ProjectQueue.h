@@ -0,0 +1,192 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <numeric>
+#include <vector>
+
+#include "Data.h"
+#include "IndexedHeap.h"
+
+// Persistent priority queue over the projects that are still worth trying, ordered by the heuristic score.
+//
+// The heuristic score is score^2 - length * roles, minus 3 per day the project could still wait before starting,
+// minus 1 per day it finishes late, see ProjectTable::heuristic_keys. Before its latest on-time start day the score
+// grows by 3 per day, afterwards it drops by 1 per day, so within each of the two regimes the relative order never
+// changes as days pass. Each regime gets its own heap with day-independent keys, and projects move from the early to
+// the late heap once their latest on-time start day has come. Nothing needs re-scoring when the clock advances.
+//
+// Projects that the prefilter rejected are parked until contributors get released, and a release only takes back the
+// ones it could matter to. Projects past their best before day are evicted for good, as they were never considered
+// again by the simulation anyway.
+class ProjectQueue
+{
+public:
+    ProjectQueue() = default;
+
+    explicit ProjectQueue(const ProjectTable& projects)
+            : projects(&projects)
+            , slot(projects.size(), Slot::None)
+            , early_key(projects.size())
+            , late_key(projects.size())
+            , early(projects.size())
+            , late(projects.size())
+            , by_latest_start(projects.size())
+            , listed(projects.size(), false)
+    {
+        projects.heuristic_keys(early_key, late_key);
+
+        std::iota(by_latest_start.begin(), by_latest_start.end(), 0);
+        std::sort(by_latest_start.begin(), by_latest_start.end(), [&projects](int lhs, int rhs){
+            return projects.latest_start(lhs) < projects.latest_start(rhs);
+        });
+    }
+
+    [[nodiscard]] bool empty() const
+    {
+        return early.empty() && late.empty();
+    }
+
+    // Projects queued or parked
+    [[nodiscard]] int size() const
+    {
+        return early.size() + late.size() + nr_parked;
+    }
+
+    // Whether the project is queued or parked
+    [[nodiscard]] bool holds(int project_index) const
+    {
+        return slot[project_index] != Slot::None;
+    }
+
+    // Heuristic score the project would have on this day, before clamping at 0
+    [[nodiscard]] int64_t priority(int project_index, int day) const
+    {
+        if (day < projects->latest_start(project_index))
+            return early_key[project_index] + 3 * (int64_t)day;
+        return late_key[project_index] - day;
+    }
+
+    void push(int project_index, int day)
+    {
+        detach(project_index);
+        if (project_index < evict_cursor)
+            return;
+        if (day < projects->latest_start(project_index))
+        {
+            slot[project_index] = Slot::Early;
+            early.push(project_index, {early_key[project_index], project_index});
+        }
+        else
+        {
+            slot[project_index] = Slot::Late;
+            late.push(project_index, {late_key[project_index], project_index});
+        }
+    }
+
+    // Removes and returns the project with the highest heuristic score on this day, ties going to the higher index
+    int pop(int day)
+    {
+        bool take_early = !early.empty();
+        if (!early.empty() && !late.empty())
+        {
+            std::pair<int64_t, int> early_top = {early.top_key().first + 3 * (int64_t)day, (int)early.top()};
+            std::pair<int64_t, int> late_top = {late.top_key().first - day, (int)late.top()};
+            take_early = early_top > late_top;
+        }
+
+        int project_index = take_early ? early.pop() : late.pop();
+        slot[project_index] = Slot::None;
+        return project_index;
+    }
+
+    // The project could not be done with the contributors available right now
+    void park(int project_index)
+    {
+        detach(project_index);
+        if (project_index < evict_cursor)
+            return;
+        slot[project_index] = Slot::Parked;
+        ++nr_parked;
+        if (!listed[project_index])
+        {
+            listed[project_index] = true;
+            parked.push_back(project_index);
+        }
+    }
+
+    // Moves projects whose latest on-time start day has come to the late heap, and evicts those past their best
+    // before day. Has to be called with non-decreasing days
+    void advance_to(int day)
+    {
+        for (; late_cursor < by_latest_start.size(); ++late_cursor)
+        {
+            int project_index = by_latest_start[late_cursor];
+            if (projects->latest_start(project_index) > day)
+                break;
+            if (slot[project_index] == Slot::Early)
+                push(project_index, day);
+        }
+
+        // Projects are sorted by best before day
+        for (; evict_cursor < projects->size() && projects->best_before_day[evict_cursor] < day; ++evict_cursor)
+            detach(evict_cursor);
+    }
+
+    // Hands back all the parked projects so that they can be checked again, they are no longer part of the queue
+    std::vector<int> take_parked()
+    {
+        return take_parked_if([](int){ return true; });
+    }
+
+    // Hands back the parked projects for which could_matter is true, the others stay parked
+    template <typename Predicate>
+    std::vector<int> take_parked_if(Predicate could_matter)
+    {
+        std::vector<int> taken;
+        size_t nr_kept = 0;
+        for (int project_index : parked)
+        {
+            if (slot[project_index] == Slot::Parked && !could_matter(project_index))
+            {
+                parked[nr_kept++] = project_index;
+                continue;
+            }
+            listed[project_index] = false;
+            if (slot[project_index] == Slot::Parked)
+            {
+                slot[project_index] = Slot::None;
+                --nr_parked;
+                taken.push_back(project_index);
+            }
+        }
+        parked.resize(nr_kept);
+        return taken;
+    }
+
+private:
+    enum class Slot : uint8_t { None, Early, Late, Parked };
+    using Key = std::pair<int64_t, int>;
+
+    const ProjectTable* projects = nullptr;
+    std::vector<Slot> slot;
+    std::vector<int64_t> early_key, late_key;
+    IndexedHeap<Key, std::greater<Key>> early, late;
+    std::vector<int> parked, by_latest_start;
+    // Whether the project is in parked, which keeps the projects no longer parked until the next take
+    std::vector<bool> listed;
+    size_t late_cursor = 0;
+    int evict_cursor = 0, nr_parked = 0;
+
+    void detach(int project_index)
+    {
+        if (slot[project_index] == Slot::Early)
+            early.erase(project_index);
+        else if (slot[project_index] == Slot::Late)
+            late.erase(project_index);
+        else if (slot[project_index] == Slot::Parked)
+            --nr_parked;
+        // Parked entries are dropped lazily by take_parked_if
+        slot[project_index] = Slot::None;
+    }
+};
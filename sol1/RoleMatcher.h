@@ -0,0 +1,375 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <numeric>
+#include <vector>
+
+#include "Profiler.h"
+#include "SearchResult.h"
+#include "SimulationState.h"
+
+using namespace std::chrono;
+
+// Allocation search that propagates constraints instead of only failing at the leaves.
+//
+// Every role gets the set of available contributors that could fill it, possibly with mentoring (skill >= level - 1).
+// Roles are filled most constrained first, and a perfect role -> contributor matching over these sets is kept up to
+// date during the whole search: it is built with Hopcroft-Karp at the root, and after every choice repaired with a
+// single augmenting path. When no augmenting path exists, no allocation extends the current choices and the branch is
+// cut. The number of chosen contributors able to mentor each role is also tracked, so a role filled by a mentee is
+// dropped as soon as nobody left could mentor it.
+//
+// Running out of branches before the deadline proves that the project cannot be done on this day.
+class RoleMatcher
+{
+public:
+    static SearchResult find_alloc(const SimulationState& simulation_state,
+                                   std::span<const SkillToLevel> project_roles,
+                                   const SearchLimits& limits = {})
+    {
+        PROFILE_SCOPE(RoleMatching);
+        Search search(simulation_state, project_roles);
+        return search.run(limits);
+    }
+
+private:
+    struct Search
+    {
+        static constexpr int NONE = -1;
+        static constexpr uint64_t DEADLINE_CHECK_INTERVAL = 4096;
+
+        const SimulationState& simulation_state;
+        const SkillMatrix& skill_matrix;
+        const std::span<const SkillToLevel> roles;
+        const int nr_roles;
+        const uint32_t nr_words;
+
+        // Available contributors able to fill each role, at skill >= level - 1
+        std::vector<Bitset> candidates;
+        // Roles in the order they are filled
+        std::vector<int> order;
+        // Contributor fixed for each role, NONE while the role is still open
+        std::vector<int> assigned;
+        // Contributors fixed for some role
+        Bitset chosen;
+        // Perfect matching consistent with the fixed roles
+        std::vector<int> match_of_role, match_of_contr;
+        // Fixed contributors with skill >= level for each role
+        std::vector<int> mentor_count;
+
+        // Hopcroft-Karp layers and the augmenting path scratch space
+        std::vector<int> distance, queue;
+        Bitset visited;
+
+        Search(const SimulationState& simulation_state, std::span<const SkillToLevel> roles)
+                : simulation_state(simulation_state)
+                , skill_matrix(simulation_state.skill_matrix)
+                , roles(roles)
+                , nr_roles(roles.size())
+                , nr_words(simulation_state.available.nr_words())
+                , order(roles.size())
+                , assigned(roles.size(), NONE)
+                , chosen(simulation_state.data.nr_contributors)
+                , match_of_role(roles.size(), NONE)
+                , match_of_contr(simulation_state.data.nr_contributors, NONE)
+                , mentor_count(roles.size(), 0)
+                , distance(roles.size())
+                , visited(simulation_state.data.nr_contributors)
+        {
+            candidates.reserve(nr_roles);
+            for (const auto& [skill_id, level_req] : roles)
+            {
+                candidates.emplace_back(simulation_state.available);
+                candidates.back() &= skill_matrix.contributors_at_least(skill_id, level_req - 1);
+            }
+
+            // Fewest candidates first, then fewest candidates who need no mentoring
+            std::vector<std::pair<uint32_t, uint32_t>> tightness(nr_roles);
+            for (int role = 0; role < nr_roles; ++role)
+                tightness[role] = {candidates[role].count(),
+                                   Bitset::count_common(candidates[role],
+                                                        skill_matrix.contributors_at_least(roles[role].first, roles[role].second))};
+            std::iota(order.begin(), order.end(), 0);
+            std::stable_sort(order.begin(), order.end(), [&tightness](int lhs, int rhs){
+                return tightness[lhs] < tightness[rhs];
+            });
+        }
+
+        // Builds a maximum matching of all the open roles, returns whether it is perfect
+        bool hopcroft_karp()
+        {
+            while (build_layers())
+                for (int role = 0; role < nr_roles; ++role)
+                    if (match_of_role[role] == NONE)
+                        layered_augment(role);
+            return std::all_of(match_of_role.begin(), match_of_role.end(), [](int contr){ return contr != NONE; });
+        }
+
+        bool build_layers()
+        {
+            queue.clear();
+            for (int role = 0; role < nr_roles; ++role)
+            {
+                distance[role] = match_of_role[role] == NONE ? 0 : INT32_MAX;
+                if (match_of_role[role] == NONE)
+                    queue.push_back(role);
+            }
+
+            bool reaches_free_contributor = false;
+            for (size_t head = 0; head < queue.size(); ++head)
+            {
+                int role = queue[head];
+                candidates[role].for_each([&](uint32_t contr_id){
+                    int next_role = match_of_contr[contr_id];
+                    if (next_role == NONE)
+                        reaches_free_contributor = true;
+                    else if (distance[next_role] == INT32_MAX)
+                    {
+                        distance[next_role] = distance[role] + 1;
+                        queue.push_back(next_role);
+                    }
+                    return true;
+                });
+            }
+            return reaches_free_contributor;
+        }
+
+        bool layered_augment(int role)
+        {
+            bool augmented = false;
+            candidates[role].for_each([&](uint32_t contr_id){
+                int next_role = match_of_contr[contr_id];
+                if (next_role == NONE || (distance[next_role] == distance[role] + 1 && layered_augment(next_role)))
+                {
+                    match_of_role[role] = contr_id;
+                    match_of_contr[contr_id] = role;
+                    augmented = true;
+                }
+                return !augmented;
+            });
+            if (!augmented)
+                distance[role] = INT32_MAX;
+            return augmented;
+        }
+
+        // Looks for an augmenting path from an unmatched open role, through contributors not fixed for another role
+        bool augment(int role)
+        {
+            visited.clear();
+            return augment_from(role);
+        }
+
+        bool augment_from(int role)
+        {
+            const auto* words = candidates[role].data();
+            auto* seen = visited.data();
+            const auto* taken = chosen.data();
+            for (uint32_t word_index = 0; word_index < nr_words; ++word_index)
+                for (uint64_t word = words[word_index] & ~taken[word_index] & ~seen[word_index]; word; word &= word - 1)
+                {
+                    uint32_t contr_id = (word_index << 6) | std::countr_zero(word);
+                    if (visited.test(contr_id))
+                        continue;
+                    visited.set(contr_id);
+
+                    int next_role = match_of_contr[contr_id];
+                    if (next_role == NONE || augment_from(next_role))
+                    {
+                        match_of_role[role] = contr_id;
+                        match_of_contr[contr_id] = role;
+                        return true;
+                    }
+                }
+            return false;
+        }
+
+        // Whether someone fixed, or some candidate for another open role, has the skill of the role at its level
+        bool could_be_mentored(int role)
+        {
+            if (mentor_count[role])
+                return true;
+
+            const auto& mentors = skill_matrix.contributors_at_least(roles[role].first, roles[role].second);
+            for (int other = 0; other < nr_roles; ++other)
+                if (other != role && assigned[other] == NONE &&
+                    Bitset::intersects_excluding(candidates[other], mentors, chosen))
+                    return true;
+            return false;
+        }
+
+        [[nodiscard]] bool is_mentee(int role) const
+        {
+            return skill_matrix.level(assigned[role], roles[role].first) == roles[role].second - 1;
+        }
+
+        void fix(int role, uint32_t contr_id)
+        {
+            assigned[role] = contr_id;
+            chosen.set(contr_id);
+            for (int other = 0; other < nr_roles; ++other)
+                if (skill_matrix.has_skill_at_level(contr_id, roles[other].first, roles[other].second))
+                    mentor_count[other]++;
+        }
+
+        void unfix(int role)
+        {
+            uint32_t contr_id = assigned[role];
+            assigned[role] = NONE;
+            chosen.reset(contr_id);
+            for (int other = 0; other < nr_roles; ++other)
+                if (skill_matrix.has_skill_at_level(contr_id, roles[other].first, roles[other].second))
+                    mentor_count[other]--;
+        }
+
+        // Moves the matching so that role gets contr_id, returns false if the other open roles can no longer all be
+        // matched. In that case the displaced role is left in exposed_role
+        bool rematch(int role, uint32_t contr_id, int& exposed_role)
+        {
+            exposed_role = NONE;
+            if (match_of_role[role] == (int)contr_id)
+                return true;
+
+            int displaced = match_of_contr[contr_id];
+            match_of_contr[match_of_role[role]] = NONE;
+            match_of_role[role] = contr_id;
+            match_of_contr[contr_id] = role;
+            if (displaced == NONE)
+                return true;
+
+            match_of_role[displaced] = NONE;
+            if (augment(displaced))
+                return true;
+            exposed_role = displaced;
+            return false;
+        }
+
+        // All fixed mentees still have someone who could mentor them
+        bool mentees_are_covered()
+        {
+            for (int role = 0; role < nr_roles; ++role)
+                if (assigned[role] != NONE && !mentor_count[role] && is_mentee(role) && !could_be_mentored(role))
+                    return false;
+            return true;
+        }
+
+        // Where the search is for one depth: the candidate level, the word of that level's bitset, and the
+        // candidates of that word still to be tried
+        struct Frame
+        {
+            int level;
+            uint32_t word_index;
+            uint64_t candidates;
+            bool level_checked;
+            // Mentees are only tried first when a mentor is already on the team
+            bool mentees_last;
+        };
+
+        // Levels are visited from level_req - 1 upwards, or from level_req upwards with level_req - 1 last
+        [[nodiscard]] static int next_level(const Frame& frame, int level_req)
+        {
+            if (!frame.mentees_last)
+                return frame.level + 1;
+            if (frame.level == level_req - 1)
+                return MAX_LEVEL + 1;
+            return frame.level == MAX_LEVEL ? level_req - 1 : frame.level + 1;
+        }
+
+        SearchResult run(const SearchLimits& limits)
+        {
+            SearchResult result;
+            auto start = steady_clock::now();
+            auto deadline = start + limits.time_limit;
+            auto finish = [&](SearchResult::Status status){
+                result.status = status;
+                result.seconds = duration<double>(steady_clock::now() - start).count();
+                return result;
+            };
+
+            if (!hopcroft_karp())
+                return finish(SearchResult::Status::Exhausted);
+
+            std::vector<Frame> frames(nr_roles);
+            auto enter = [&](int depth){
+                int role = order[depth];
+                bool mentees_last = !mentor_count[role];
+                frames[depth] = {roles[role].second - !mentees_last, 0, 0, false, mentees_last};
+            };
+
+            int depth = 0, exposed_role = NONE;
+            enter(0);
+            while (depth >= 0)
+            {
+                if ((++result.nodes % DEADLINE_CHECK_INTERVAL) == 0)
+                {
+                    if (limits.is_cancelled())
+                        return finish(SearchResult::Status::Cancelled);
+                    if (steady_clock::now() >= deadline)
+                        return finish(SearchResult::Status::TimedOut);
+                }
+
+                auto& frame = frames[depth];
+                int role = order[depth];
+                const auto [skill_id, level_req] = roles[role];
+
+                // Undo the previous choice at this depth, the looser problem always has a perfect matching again
+                if (assigned[role] != NONE)
+                {
+                    unfix(role);
+                    if (exposed_role != NONE && !augment(exposed_role))
+                        return finish(SearchResult::Status::Exhausted);
+                    exposed_role = NONE;
+                }
+
+                while (!frame.candidates && frame.level <= MAX_LEVEL)
+                {
+                    if (!frame.level_checked)
+                    {
+                        frame.level_checked = true;
+                        // Contributors one level short need a mentor on the team
+                        if (frame.level == level_req - 1 && !could_be_mentored(role))
+                        {
+                            frame = {next_level(frame, level_req), 0, 0, false, frame.mentees_last};
+                            continue;
+                        }
+                        frame.word_index = skill_matrix.next_word_at(skill_id, frame.level, 0);
+                    }
+                    else
+                        frame.word_index = skill_matrix.next_word_at(skill_id, frame.level, frame.word_index + 1);
+                    if (frame.word_index >= nr_words)
+                    {
+                        frame = {next_level(frame, level_req), 0, 0, false, frame.mentees_last};
+                        continue;
+                    }
+                    frame.candidates = skill_matrix.word_at(skill_id, frame.level, frame.word_index) &
+                                       candidates[role].data()[frame.word_index] &
+                                       ~chosen.data()[frame.word_index];
+                }
+
+                if (!frame.candidates)
+                {
+                    --depth;
+                    continue;
+                }
+
+                uint32_t contr_id = (frame.word_index << 6) | std::countr_zero(frame.candidates);
+                frame.candidates &= frame.candidates - 1;
+
+                fix(role, contr_id);
+                if (!rematch(role, contr_id, exposed_role) || !mentees_are_covered())
+                    continue;
+
+                if (depth + 1 == nr_roles)
+                {
+                    for (int other = 0; other < nr_roles; ++other)
+                        result.learning_points += is_mentee(other);
+                    result.contributor_ids.assign(assigned.begin(), assigned.end());
+                    return finish(SearchResult::Status::Found);
+                }
+
+                enter(++depth);
+            }
+            return finish(SearchResult::Status::Exhausted);
+        }
+    };
+};
@@ -0,0 +1,571 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "Data.h"
+#include "Profiler.h"
+#include "TaskScheduler.h"
+
+struct OptimizerOptions
+{
+    // Wall clock budget of the whole optimization
+    std::chrono::steady_clock::duration time_limit = std::chrono::seconds(10);
+    // Annealing chains run in parallel, 0 for one per scheduler worker
+    int nr_threads = 0;
+    // Chains that fell behind restart from the best schedule found so far this often
+    std::chrono::steady_clock::duration epoch = std::chrono::milliseconds(500);
+    // In score points, 0 derives it from the schedule. Cools down geometrically to a thousandth of it
+    double start_temperature = 0;
+    uint64_t seed = 1;
+};
+
+struct OptimizerResult
+{
+    // Whether the strict replay accepted the schedule given, the others are returned as they are
+    bool valid = false;
+    std::vector<ProjectAllocation> schedule;
+    int64_t initial_score = 0, score = 0;
+    uint64_t moves = 0, accepted = 0;
+    double seconds = 0;
+    int nr_threads = 0;
+};
+
+// Improves a finished schedule by simulated annealing, with the scoring of Validator's strict timing: projects run in
+// schedule order, each starting once its whole team is free, and mentees level up right away.
+//
+// A move reorders a project, hands a role to someone else, inserts a project that is not scheduled or drops one. Every
+// chain keeps the replay of its schedule in an undo log tagged with positions. A move rewinds to the first position it
+// changes and replays from there, but only until the busy days and levels are back to those of the original schedule:
+// from that point on both play out the same, and the original points still hold. A rejected move is rewound again.
+// Chains anneal independently, and the ones behind restart from the best schedule after each epoch.
+//
+// Every chain keeps a full contributor x skill table of levels, so inputs in the sparse skill layout are not for it.
+class ScheduleOptimizer
+{
+public:
+    static OptimizerResult optimize(const Data& data, const std::vector<ProjectAllocation>& schedule,
+                                    const OptimizerOptions& options, TaskScheduler& scheduler = TaskScheduler::global())
+    {
+        using namespace std::chrono;
+        auto start = steady_clock::now();
+        auto deadline = start + options.time_limit;
+
+        OptimizerResult result;
+        result.schedule = schedule;
+        result.nr_threads = options.nr_threads > 0 ? options.nr_threads : scheduler.size();
+
+        std::vector<Chain> chains;
+        chains.reserve(result.nr_threads);
+        for (int chain = 0; chain < result.nr_threads; ++chain)
+            chains.emplace_back(data, options.seed + chain * 0x9e3779b97f4a7c15ULL);
+
+        if (!chains[0].reset(schedule))
+            return result;
+        result.valid = true;
+        result.initial_score = result.score = chains[0].score;
+
+        double start_temperature = options.start_temperature;
+        if (start_temperature <= 0)
+            start_temperature = std::max(1.0, (double)result.initial_score / std::max<size_t>(1, schedule.size()) / 20);
+
+        while (steady_clock::now() < deadline)
+        {
+            PROFILE_SCOPE(OptimizeEpoch);
+            auto epoch_end = std::min(deadline, steady_clock::now() + options.epoch);
+            TaskGroup group(scheduler);
+            for (auto& chain : chains)
+                group.run([&]{
+                    if (chain.best_score < result.score || chain.schedule.empty())
+                        chain.reset(result.schedule);
+                    chain.anneal(epoch_end, [&](steady_clock::time_point now){
+                        double progress = duration<double>(now - start) / duration<double>(options.time_limit);
+                        return start_temperature * std::pow(1e-3, std::min(1.0, progress));
+                    });
+                });
+            group.wait();
+
+            for (auto& chain : chains)
+                if (chain.best_score > result.score)
+                {
+                    result.score = chain.best_score;
+                    result.schedule = chain.best_schedule;
+                }
+        }
+
+        for (const auto& chain : chains)
+        {
+            result.moves += chain.moves;
+            result.accepted += chain.accepted;
+        }
+        result.seconds = duration<double>(steady_clock::now() - start).count();
+        return result;
+    }
+
+private:
+    class Chain
+    {
+    public:
+        std::vector<ProjectAllocation> schedule, best_schedule;
+        int64_t score = 0, best_score = -1;
+        uint64_t moves = 0, accepted = 0;
+
+        Chain(const Data& data, uint64_t seed)
+                : data(data)
+                , nr_skills(data.skills.size())
+                , initial_levels((size_t)data.nr_contributors * nr_skills)
+                , busy_until(data.nr_contributors, 0)
+                , team_stamp(data.nr_contributors, 0)
+                , scheduled(data.nr_projects, false)
+                , random(seed)
+                , busy_reference(data.nr_contributors, 0)
+                , reference_stamp(data.nr_contributors, 0)
+                , dirty_stamp(data.nr_contributors, 0)
+        {
+            for (uint32_t contr_id = 0; contr_id < (uint32_t)data.nr_contributors; ++contr_id)
+                for (uint32_t skill_id = 0; skill_id < nr_skills; ++skill_id)
+                    initial_levels[(size_t)contr_id * nr_skills + skill_id] = data.skill_matrix.level(contr_id, skill_id);
+            levels = initial_levels;
+        }
+
+        // Replays the schedule from scratch, returns whether it is valid
+        bool reset(const std::vector<ProjectAllocation>& new_schedule)
+        {
+            levels = initial_levels;
+            std::fill(busy_until.begin(), busy_until.end(), 0);
+            std::fill(scheduled.begin(), scheduled.end(), false);
+            undo_log.clear();
+
+            schedule = new_schedule;
+            starting_day.assign(schedule.size(), 0);
+            points.assign(schedule.size(), 0);
+            score = 0;
+            for (const auto& [project_index, contributor_ids] : schedule)
+                scheduled[project_index] = true;
+            for (replayed = 0; replayed < schedule.size(); ++replayed)
+            {
+                if (!apply(replayed, starting_day[replayed], points[replayed]))
+                    return false;
+                score += points[replayed];
+            }
+            if (score > best_score)
+            {
+                best_score = score;
+                best_schedule = schedule;
+            }
+            return true;
+        }
+
+        template <typename Temperature>
+        void anneal(std::chrono::steady_clock::time_point until, const Temperature& temperature_at)
+        {
+            double temperature = 1;
+            for (uint64_t step = 0;; ++step)
+            {
+                if (step % 64 == 0)
+                {
+                    auto now = std::chrono::steady_clock::now();
+                    if (now >= until)
+                        break;
+                    temperature = temperature_at(now);
+                }
+                try_move(temperature);
+            }
+        }
+
+    private:
+        // One change made by the replay, undone when rewinding before the position it was made at
+        struct Change
+        {
+            uint32_t position;
+            bool is_level;
+            // Index into levels, or contributor id
+            size_t index;
+            int old_value;
+        };
+
+        // Moves land within this many positions of a cursor that sweeps the schedule, so that the replay state is
+        // usually close to where the next move needs it
+        static constexpr size_t window = 64;
+
+        const Data& data;
+        const uint32_t nr_skills;
+        std::vector<uint8_t> initial_levels, levels;
+        std::vector<int> busy_until;
+        std::vector<uint64_t> team_stamp;
+        std::vector<bool> scheduled;
+        std::mt19937_64 random;
+        size_t cursor = 0;
+
+        // Starting day and points of every project of the schedule
+        std::vector<int> starting_day, points;
+        std::vector<Change> undo_log;
+        // The levels and busy days are the ones after the first replayed positions
+        size_t replayed = 0;
+        uint64_t stamp = 0;
+
+        // While a move is scored: what the original schedule has where the candidate may differ, and which of it
+        // differs right now. Once nothing differs, the rest of the candidate plays out like the original
+        std::vector<int> busy_reference;
+        std::vector<uint64_t> reference_stamp, dirty_stamp;
+        std::vector<uint32_t> touched;
+        std::vector<std::pair<size_t, int>> level_reference;
+        std::vector<int> candidate_day, candidate_points;
+        uint64_t move_stamp = 0;
+        size_t nr_dirty = 0;
+
+        size_t pick(size_t bound)
+        {
+            return std::uniform_int_distribution<size_t>(0, bound - 1)(random);
+        }
+
+        // A position in [0, bound), usually near the cursor
+        size_t pick_near_cursor(size_t bound)
+        {
+            if (pick(16) == 0)
+                return pick(bound);
+            size_t position = cursor + pick(2 * window + 1);
+            return position < window ? 0 : std::min(bound - 1, position - window);
+        }
+
+        // Same checks and scoring as Validator's strict timing, for one position
+        bool apply(uint32_t position, int& starting_day_out, int& points_out)
+        {
+            const auto& [project_index, contributor_ids] = schedule[position];
+            const auto roles = data.projects.roles(project_index);
+            if (contributor_ids.size() != roles.size())
+                return false;
+
+            ++stamp;
+            int day = 0;
+            for (uint32_t contr_id : contributor_ids)
+            {
+                if (team_stamp[contr_id] == stamp)
+                    return false;
+                team_stamp[contr_id] = stamp;
+                day = std::max(day, busy_until[contr_id]);
+            }
+
+            for (size_t role = 0; role < roles.size(); ++role)
+            {
+                const auto& [skill_id, level_req] = roles[role];
+                size_t index = (size_t)contributor_ids[role] * nr_skills + skill_id;
+                if (levels[index] < level_req - 1)
+                    return false;
+                if (levels[index] == level_req - 1)
+                {
+                    bool has_mentor = std::any_of(contributor_ids.begin(), contributor_ids.end(), [&](uint32_t other){
+                        return levels[(size_t)other * nr_skills + skill_id] >= level_req;
+                    });
+                    if (!has_mentor)
+                        return false;
+                    undo_log.push_back({position, true, index, levels[index]});
+                    levels[index] = std::min(levels[index] + 1, MAX_LEVEL);
+                }
+            }
+
+            for (uint32_t contr_id : contributor_ids)
+            {
+                undo_log.push_back({position, false, contr_id, busy_until[contr_id]});
+                busy_until[contr_id] = day + data.projects.length_in_days[project_index];
+            }
+
+            starting_day_out = day;
+            points_out = data.projects.actual_score(project_index, day);
+            return true;
+        }
+
+        // Brings the levels and busy days to the state right before position, which has to be valid up to there
+        void seek(size_t position)
+        {
+            while (!undo_log.empty() && undo_log.back().position >= position)
+                undo(undo_log.back());
+            int day, project_points;
+            for (; replayed < position; ++replayed)
+                apply(replayed, day, project_points);
+            replayed = position;
+        }
+
+        void undo(const Change& change)
+        {
+            if (change.is_level)
+                levels[change.index] = change.old_value;
+            else
+                busy_until[change.index] = change.old_value;
+            undo_log.pop_back();
+        }
+
+        [[nodiscard]] std::vector<std::pair<size_t, int>>::iterator find_level_reference(size_t index)
+        {
+            return std::find_if(level_reference.begin(), level_reference.end(), [index](const auto& reference){
+                return reference.first == index;
+            });
+        }
+
+        // Remembers what the state is at the end of the positions a move changes, then rewinds to the first of them
+        void rewind_for_move(size_t position, size_t original_end)
+        {
+            seek(original_end);
+            ++move_stamp;
+            touched.clear();
+            level_reference.clear();
+            while (!undo_log.empty() && undo_log.back().position >= position)
+            {
+                const auto& change = undo_log.back();
+                if (change.is_level && find_level_reference(change.index) == level_reference.end())
+                    level_reference.emplace_back(change.index, levels[change.index]);
+                else if (!change.is_level && reference_stamp[change.index] != move_stamp)
+                {
+                    reference_stamp[change.index] = move_stamp;
+                    busy_reference[change.index] = busy_until[change.index];
+                    touched.push_back(change.index);
+                }
+                undo(change);
+            }
+            replayed = position;
+        }
+
+        void set_dirty(uint32_t contr_id, bool dirty)
+        {
+            bool was_dirty = dirty_stamp[contr_id] == move_stamp;
+            dirty_stamp[contr_id] = dirty ? move_stamp : 0;
+            nr_dirty += (size_t)dirty - (size_t)was_dirty;
+        }
+
+        // Scores the schedule changed between positions position and end, which stand for the original positions up to
+        // end + shift. The positions after it are replayed only until the state is back to the original one. Keeps
+        // the change, or lets undo_move revert it
+        template <typename UndoMove>
+        void evaluate(size_t position, size_t end, ptrdiff_t shift, double temperature, const UndoMove& undo_move)
+        {
+            ++moves;
+            PROFILE_COUNT(OptimizerMoves, 1);
+            candidate_day.clear();
+            candidate_points.clear();
+            int64_t delta = 0;
+            size_t log_mark = undo_log.size(), next = position;
+            bool valid = true;
+
+            for (; valid && next < end; ++next)
+                valid = replay_candidate(next, delta);
+
+            if (valid)
+            {
+                // What only the candidate changed was the same in the original, before and after
+                for (size_t change_index = log_mark; change_index < undo_log.size(); ++change_index)
+                {
+                    const auto& change = undo_log[change_index];
+                    if (change.is_level && find_level_reference(change.index) == level_reference.end())
+                        level_reference.emplace_back(change.index, change.old_value);
+                    else if (!change.is_level && reference_stamp[change.index] != move_stamp)
+                    {
+                        reference_stamp[change.index] = move_stamp;
+                        busy_reference[change.index] = change.old_value;
+                        touched.push_back(change.index);
+                    }
+                }
+                nr_dirty = 0;
+                for (uint32_t contr_id : touched)
+                    set_dirty(contr_id, busy_until[contr_id] != busy_reference[contr_id]);
+                std::erase_if(level_reference, [this](const auto& reference){
+                    return levels[reference.first] == reference.second;
+                });
+                nr_dirty += level_reference.size();
+
+                for (size_t original = position; original < end + shift; ++original)
+                    delta -= points[original];
+                for (; valid && nr_dirty && next < schedule.size(); ++next)
+                    valid = replay_lined_up(next, next + shift, delta);
+            }
+
+            if (valid && (delta >= 0 || std::uniform_real_distribution<double>(0, 1)(random) < std::exp(delta / temperature)))
+            {
+                ++accepted;
+                PROFILE_COUNT(OptimizerAccepted, 1);
+                score += delta;
+                splice(starting_day, position, next + shift, candidate_day);
+                splice(points, position, next + shift, candidate_points);
+                replayed = next;
+                if (score > best_score)
+                {
+                    best_score = score;
+                    best_schedule = schedule;
+                }
+                return;
+            }
+            replayed = next;
+            seek(position);
+            undo_move();
+        }
+
+        bool replay_candidate(size_t position, int64_t& delta)
+        {
+            int day, project_points;
+            if (!apply(position, day, project_points))
+                return false;
+            candidate_day.push_back(day);
+            candidate_points.push_back(project_points);
+            delta += project_points;
+            return true;
+        }
+
+        // Replays a position that runs the same project with the same team as the original position
+        bool replay_lined_up(size_t position, size_t original, int64_t& delta)
+        {
+            if (!replay_candidate(position, delta))
+                return false;
+            delta -= points[original];
+
+            const auto& [project_index, contributor_ids] = schedule[position];
+            const auto roles = data.projects.roles(project_index);
+            for (uint32_t contr_id : contributor_ids)
+                set_dirty(contr_id, busy_until[contr_id] != starting_day[original] + data.projects.length_in_days[project_index]);
+
+            // Where the levels agreed, both schedules leveled up the same. Where they did not, the original leveled
+            // up exactly if it was one short, as it is valid
+            for (size_t role = 0; role < roles.size(); ++role)
+            {
+                const auto& [skill_id, level_req] = roles[role];
+                auto reference = find_level_reference((size_t)contributor_ids[role] * nr_skills + skill_id);
+                if (reference == level_reference.end())
+                    continue;
+                if (reference->second == level_req - 1)
+                    reference->second = std::min(reference->second + 1, MAX_LEVEL);
+                if (levels[reference->first] == reference->second)
+                {
+                    level_reference.erase(reference);
+                    --nr_dirty;
+                }
+            }
+            return true;
+        }
+
+        // Replaces values[begin, end) with replacement
+        static void splice(std::vector<int>& values, size_t begin, size_t end, const std::vector<int>& replacement)
+        {
+            values.erase(values.begin() + begin, values.begin() + end);
+            values.insert(values.begin() + begin, replacement.begin(), replacement.end());
+        }
+
+        void try_move(double temperature)
+        {
+            auto move = pick(100);
+            if (schedule.empty() || move < 15)
+                insert_project(temperature);
+            else if (move < 55)
+                shift_project(temperature);
+            else if (move < 95)
+                reassign_role(temperature);
+            else
+                drop_project(temperature);
+            cursor = schedule.empty() ? 0 : (cursor + 1) % schedule.size();
+        }
+
+        // Moves a project a few places earlier or later
+        void shift_project(double temperature)
+        {
+            if (schedule.size() < 2)
+                return;
+            size_t from = pick_near_cursor(schedule.size());
+            size_t lowest = from > window ? from - window : 0, highest = std::min(schedule.size() - 1, from + window);
+            size_t to = lowest + pick(highest - lowest + 1);
+            if (to == from)
+                return;
+
+            auto move_project = [this](size_t from, size_t to){
+                auto allocation = std::move(schedule[from]);
+                schedule.erase(schedule.begin() + from);
+                schedule.insert(schedule.begin() + to, std::move(allocation));
+            };
+            size_t first = std::min(from, to), end = std::max(from, to) + 1;
+            rewind_for_move(first, end);
+            move_project(from, to);
+            evaluate(first, end, 0, temperature, [&]{ move_project(to, from); });
+        }
+
+        // Gives a role to someone who has the skill at that point of the schedule, or swaps it with a teammate's
+        void reassign_role(double temperature)
+        {
+            size_t position = pick_near_cursor(schedule.size());
+            auto& contributor_ids = schedule[position].second;
+            const auto roles = data.projects.roles(schedule[position].first);
+            size_t role = pick(roles.size());
+            const auto& [skill_id, level_req] = roles[role];
+
+            uint32_t candidate;
+            const auto& skilled = data.skill_matrix.skilled_contributors(skill_id);
+            if (level_req > 1 && !skilled.empty())
+                candidate = skilled[pick(skilled.size())].first;
+            else
+                candidate = pick(data.nr_contributors);
+            if (candidate == contributor_ids[role])
+                return;
+
+            rewind_for_move(position, position + 1);
+            if (levels[(size_t)candidate * nr_skills + skill_id] < level_req - 1)
+                return;
+
+            auto previous = contributor_ids;
+            auto teammate = std::find(contributor_ids.begin(), contributor_ids.end(), candidate);
+            if (teammate != contributor_ids.end())
+                std::swap(*teammate, contributor_ids[role]);
+            else
+                contributor_ids[role] = candidate;
+            evaluate(position, position + 1, 0, temperature, [&]{ schedule[position].second = std::move(previous); });
+        }
+
+        // Schedules a project that is not, with a team of the earliest free contributors qualified at that point
+        void insert_project(double temperature)
+        {
+            int project_index = pick(data.nr_projects);
+            if (scheduled[project_index])
+                return;
+            const auto& projects = data.projects;
+            size_t position = schedule.empty() ? 0 : pick_near_cursor(schedule.size() + 1);
+            rewind_for_move(position, position);
+
+            ++stamp;
+            std::vector<uint32_t> contributor_ids;
+            int day = 0;
+            for (const auto& [skill_id, level_req] : projects.roles(project_index))
+            {
+                uint32_t chosen = UINT32_MAX;
+                for (const auto& [contr_id, initial_level] : data.skill_matrix.skilled_contributors(skill_id))
+                    if (team_stamp[contr_id] != stamp && levels[(size_t)contr_id * nr_skills + skill_id] >= level_req &&
+                        (chosen == UINT32_MAX || busy_until[contr_id] < busy_until[chosen]))
+                        chosen = contr_id;
+                if (chosen == UINT32_MAX)
+                    return;
+                team_stamp[chosen] = stamp;
+                contributor_ids.push_back(chosen);
+                day = std::max(day, busy_until[chosen]);
+            }
+            // It would only hold its team up
+            if (day + projects.length_in_days[project_index] - projects.best_before_day[project_index] >= projects.score[project_index])
+                return;
+
+            schedule.insert(schedule.begin() + position, {project_index, std::move(contributor_ids)});
+            scheduled[project_index] = true;
+            evaluate(position, position + 1, -1, temperature, [&]{
+                schedule.erase(schedule.begin() + position);
+                scheduled[project_index] = false;
+            });
+        }
+
+        void drop_project(double temperature)
+        {
+            size_t position = pick_near_cursor(schedule.size());
+            rewind_for_move(position, position + 1);
+            auto allocation = std::move(schedule[position]);
+            schedule.erase(schedule.begin() + position);
+            scheduled[allocation.first] = false;
+            evaluate(position, position, 1, temperature, [&]{
+                scheduled[allocation.first] = true;
+                schedule.insert(schedule.begin() + position, std::move(allocation));
+            });
+        }
+    };
+};
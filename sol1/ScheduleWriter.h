@@ -0,0 +1,141 @@
+#pragma once
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "Data.h"
+
+// Output file that follows a schedule while it is being built. Every write keeps the allocations already in the file
+// that the schedule starts with, cuts off the ones it does not, and appends the rest, all formatted into one buffer and
+// written at once. The count on the first line is padded to a fixed width and patched in place: lowered before records
+// are cut off and raised only once the new records are in the file, so that at any point the file is a valid output of
+// the whole records it counts. A run that gets interrupted leaves the schedule as of its last write, and the write at
+// the end of a run only has the allocations of the last day left to add.
+//
+// The file is written as NAME.tmp and renamed to NAME by the first write that puts allocations in it, so a new run
+// leaves the previous output in place until it has one of its own. Later writes go to the same file, now under its
+// final name.
+class ScheduleWriter
+{
+public:
+    // Any count of allocations fits, readers skip the padding
+    static constexpr size_t HEADER_SIZE = 12;
+    // The buffer grows past it only for writes that add more than that
+    static constexpr size_t BUFFER_SIZE = 1 << 20;
+
+    ScheduleWriter(const Data& data, const std::string& filename)
+            : data(data)
+            , filename(filename)
+            , temporary(filename + ".tmp")
+            , record_end{HEADER_SIZE}
+    {
+        fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            fail("open");
+        buffer.reserve(BUFFER_SIZE);
+        write_count(0);
+    }
+
+    ScheduleWriter(const ScheduleWriter&) = delete;
+    ScheduleWriter& operator=(const ScheduleWriter&) = delete;
+
+    ~ScheduleWriter()
+    {
+        close(fd);
+        if (!published)
+            std::remove(temporary.c_str());
+    }
+
+    // Makes the file hold the schedule, and puts it in place of the previous output unless the schedule is empty
+    void write(const std::vector<ProjectAllocation>& schedule)
+    {
+        size_t nr_kept = 0;
+        while (nr_kept < written.size() && nr_kept < schedule.size() && written[nr_kept] == schedule[nr_kept])
+            ++nr_kept;
+        if (nr_kept == written.size() && nr_kept == schedule.size())
+        {
+            if (!written.empty())
+                publish();
+            return;
+        }
+
+        if (nr_kept < written.size())
+        {
+            write_count(nr_kept);
+            written.resize(nr_kept);
+            record_end.resize(nr_kept + 1);
+            if (ftruncate(fd, (off_t)record_end.back()) < 0)
+                fail("truncate");
+        }
+
+        buffer.clear();
+        for (size_t index = nr_kept; index < schedule.size(); ++index)
+        {
+            data.append_allocation(buffer, schedule[index]);
+            record_end.push_back(record_end[nr_kept] + buffer.size());
+            written.push_back(schedule[index]);
+        }
+        put(buffer.data(), buffer.size(), record_end[nr_kept]);
+        write_count(written.size());
+        if (!written.empty())
+            publish();
+    }
+
+    // Puts the file in place of the previous output even if it holds no allocation
+    void publish()
+    {
+        if (published)
+            return;
+        if (std::rename(temporary.c_str(), filename.c_str()) < 0)
+            fail("rename");
+        published = true;
+    }
+
+private:
+    const Data& data;
+    std::string filename, temporary;
+    int fd = -1;
+    // Whether the file has been renamed to filename
+    bool published = false;
+    // What the file holds, and where each record ends, after the header for none
+    std::vector<ProjectAllocation> written;
+    std::vector<size_t> record_end;
+    std::string buffer;
+
+    void write_count(size_t count)
+    {
+        char header[HEADER_SIZE];
+        std::memset(header, ' ', HEADER_SIZE);
+        std::to_chars(header, header + HEADER_SIZE - 1, count);
+        header[HEADER_SIZE - 1] = '\n';
+        put(header, HEADER_SIZE, 0);
+    }
+
+    void put(const char* bytes, size_t size, size_t offset)
+    {
+        while (size)
+        {
+            auto nr_written = pwrite(fd, bytes, size, (off_t)offset);
+            if (nr_written < 0 && errno == EINTR)
+                continue;
+            if (nr_written <= 0)
+                fail("write");
+            bytes += nr_written;
+            size -= nr_written;
+            offset += nr_written;
+        }
+    }
+
+    [[noreturn]] void fail(const char* what) const
+    {
+        throw std::runtime_error(std::string("Cannot ") + what + " " + (published ? filename : temporary) + ": " +
+                                 std::strerror(errno));
+    }
+};
@@ -0,0 +1,95 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "Data.h"
+#include "SearchResult.h"
+#include "SkillMatrix.h"
+
+// Remembers the searches that failed, so that a project is not searched again before something that could change the
+// answer has happened.
+//
+// Allocations only take contributors away, and taking contributors away never turns an infeasible project into a
+// feasible one. Only two events can: someone with one of the project's skills being released, or someone leveling up
+// in one of the project's skills. Both bump the version of the skill; a failure recorded after the last change to each
+// of the project's skills still holds. Roles of level 1 can be filled by anyone, with mentoring, so projects having one
+// also depend on every release. A proof of infeasibility holds for any budget, a timeout only for budgets up to the one
+// that ran out.
+class SearchMemo
+{
+public:
+    SearchMemo() = default;
+
+    SearchMemo(uint32_t nr_projects, uint32_t nr_skills)
+            : skill_version(nr_skills, 0)
+            , entries(nr_projects)
+    {}
+
+    void on_release(uint32_t contr_id, const SkillMatrix& skill_matrix)
+    {
+        release_version = ++clock;
+        for (const auto& [skill_id, level] : skill_matrix.skills_of_contributor(contr_id))
+            skill_version[skill_id] = clock;
+    }
+
+    void on_level_up(uint32_t skill_id)
+    {
+        skill_version[skill_id] = ++clock;
+    }
+
+    void record(int project_index, const SearchResult& result, std::chrono::steady_clock::duration budget)
+    {
+        auto& entry = entries[project_index];
+        if (result.status == SearchResult::Status::Exhausted)
+            entry = {Outcome::Infeasible, clock, budget, entry.nr_timeouts};
+        else if (result.status == SearchResult::Status::TimedOut)
+        {
+            entry = {Outcome::TimedOut, clock, budget, entry.nr_timeouts + 1};
+            ++total_timeouts;
+        }
+    }
+
+    // Searches that ran out of time so far
+    [[nodiscard]] uint64_t nr_timeouts() const
+    {
+        return total_timeouts;
+    }
+
+    // Searches of the project that ran out of time so far
+    [[nodiscard]] int nr_timeouts(int project_index) const
+    {
+        return entries[project_index].nr_timeouts;
+    }
+
+    // Whether a search with this budget is bound to fail like a previous one did
+    [[nodiscard]] bool known_to_fail(int project_index,
+                                     std::span<const SkillToLevel> roles,
+                                     std::chrono::steady_clock::duration budget) const
+    {
+        const auto& entry = entries[project_index];
+        if (entry.outcome == Outcome::Unknown)
+            return false;
+        if (entry.outcome == Outcome::TimedOut && budget > entry.budget)
+            return false;
+        for (const auto& [skill_id, level_req] : roles)
+            if (skill_version[skill_id] > entry.recorded_at || (level_req <= 1 && release_version > entry.recorded_at))
+                return false;
+        return true;
+    }
+
+private:
+    enum class Outcome : uint8_t { Unknown, Infeasible, TimedOut };
+
+    struct Entry
+    {
+        Outcome outcome = Outcome::Unknown;
+        uint64_t recorded_at = 0;
+        std::chrono::steady_clock::duration budget{};
+        int nr_timeouts = 0;
+    };
+
+    uint64_t clock = 0, release_version = 0, total_timeouts = 0;
+    std::vector<uint64_t> skill_version;
+    std::vector<Entry> entries;
+};
@@ -0,0 +1,49 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// Outcome of one allocation search for a project
+struct SearchResult
+{
+    enum class Status : uint8_t
+    {
+        Found,
+        // Every branch was explored without finding an allocation
+        Exhausted,
+        // The deadline hit before the search could finish
+        TimedOut,
+        // Another thread no longer needed the result
+        Cancelled
+    };
+
+    Status status = Status::Exhausted;
+    int learning_points = 0;
+    // Contributor id for every role, in the project's role order. Empty unless found
+    std::vector<uint32_t> contributor_ids;
+    uint64_t nodes = 0;
+    double seconds = 0;
+
+    [[nodiscard]] bool found() const
+    {
+        return status == Status::Found;
+    }
+
+    [[nodiscard]] double nodes_per_second() const
+    {
+        return seconds > 0 ? nodes / seconds : 0;
+    }
+};
+
+// How long a search may run, and a flag another thread can raise to stop it early
+struct SearchLimits
+{
+    std::chrono::steady_clock::duration time_limit = std::chrono::seconds(15);
+    const std::atomic<bool>* cancelled = nullptr;
+
+    [[nodiscard]] bool is_cancelled() const
+    {
+        return cancelled && cancelled->load(std::memory_order_relaxed);
+    }
+};
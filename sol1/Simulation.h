@@ -0,0 +1,207 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <vector>
+
+#include "Data.h"
+#include "ProjectAllocator.h"
+#include "Profiler.h"
+#include "SimulationState.h"
+
+using namespace std::chrono;
+
+// Commits an allocation on the current day: its contributors get busy, the mentored ones level up and the project
+// is scored
+inline void commit_allocation(const Data& data, SimulationState& simulation_state, const ProjectAllocation& allocation)
+{
+    simulation_state.add_allocation(allocation);
+    ProjectAllocator::update_contributors(data, simulation_state, allocation);
+    simulation_state.score_so_far += simulation_state.actual_score(allocation.first);
+}
+
+// Allocates projects on the current day until none of the remaining ones can be done, and returns them in the order
+// they were committed. The queue, the feasibility filter and the memo of failed searches serve the whole day. When
+// several candidates are searched together, every allocation found among them whose contributors are still free is
+// committed: the commits before it only raised levels, so its roles stay filled. In the anytime mode every candidate
+// gets its slice of the budget, and the day stops early once the budget is spent.
+inline std::vector<ProjectAllocation> allocate_day(const Data& data, SimulationState& simulation_state, const PortfolioOptions& options,
+                                                   std::ostream& log = std::cout)
+{
+    PROFILE_SCOPE(AllocateDay);
+    auto& project_queue = simulation_state.project_queue;
+    std::vector<int> tried_projects, candidates, candidate_scores;
+    std::vector<steady_clock::duration> time_limits;
+    std::vector<ProjectAllocation> allocations;
+
+    const double average_roles = (double)data.projects.all_roles.size() / std::max(1, data.projects.size());
+    auto time_limit_of = [&](int project_index){
+        if (!options.budget)
+            return options.time_limit;
+        // The projects still open include the ones popped for this day
+        int nr_open = project_queue.size() + tried_projects.size() + candidates.size() + 1;
+        return options.budget->slice(data.projects.nr_roles(project_index), average_roles,
+                                     simulation_state.search_memo.nr_timeouts(project_index),
+                                     simulation_state.feasibility_margin(project_index), nr_open,
+                                     options.candidates_in_flight, options.time_limit);
+    };
+
+    uint64_t nodes = 0;
+    double search_seconds = 0;
+    auto start = steady_clock::now();
+    while (!project_queue.empty() && !(options.budget && options.budget->spent()))
+    {
+        // The top candidates that can still be done are searched together
+        candidates.clear();
+        time_limits.clear();
+        while ((int)candidates.size() < options.candidates_in_flight && !project_queue.empty())
+        {
+            int project_index = project_queue.pop(simulation_state.day);
+
+            // Allocations made since the project was queued may have taken the contributors it needs
+            if (!simulation_state.can_project_be_done(project_index))
+                project_queue.park(project_index);
+            else
+            {
+                auto time_limit = time_limit_of(project_index);
+                // Nobody was released and nobody leveled up in its skills since its last search failed
+                if (simulation_state.search_memo.known_to_fail(project_index, data.projects.roles(project_index), time_limit))
+                {
+                    PROFILE_COUNT(MemoHits, 1);
+                    project_queue.park(project_index);
+                    continue;
+                }
+                candidates.push_back(project_index);
+                time_limits.push_back(time_limit);
+            }
+        }
+
+        auto results = ProjectAllocator::find_allocations_for_projects(simulation_state, candidates, options, time_limits);
+        candidate_scores.resize(candidates.size());
+        data.projects.actual_scores(simulation_state.day, candidates, candidate_scores);
+        bool committed = false;
+        for (size_t candidate = 0; candidate < candidates.size(); ++candidate)
+        {
+            int project_index = candidates[candidate];
+            auto& result = results[candidate];
+            nodes += result.nodes;
+            search_seconds += result.seconds;
+            // The filter let the project through, but a complete search proved it cannot be done
+            PROFILE_COUNT(FalsePositives, result.status == SearchResult::Status::Exhausted);
+            simulation_state.search_memo.record(project_index, result, time_limits[candidate]);
+
+            if (result.found() && !candidate_scores[candidate] && !result.learning_points)
+            {
+                simulation_state.mark_done(project_index);
+                continue;
+            }
+            bool still_free = std::ranges::all_of(result.contributor_ids, [&](uint32_t contr_id)
+                                                  { return simulation_state.available.test(contr_id); });
+            if (!result.found() || !still_free)
+            {
+                tried_projects.push_back(project_index);
+                continue;
+            }
+            allocations.emplace_back(project_index, std::move(result.contributor_ids));
+            commit_allocation(data, simulation_state, allocations.back());
+            PROFILE_COUNT(Allocations, 1);
+            committed = true;
+        }
+
+        // The commits may have raised the levels the projects tried so far were missing, their memo entries tell
+        if (committed)
+        {
+            for (int project_index : tried_projects)
+                project_queue.push(project_index, simulation_state.day);
+            tried_projects.clear();
+        }
+    }
+
+    // Projects nothing was found for stay candidates for the next day
+    for (int project_index : tried_projects)
+        project_queue.push(project_index, simulation_state.day);
+
+    auto elapsed = duration_cast<milliseconds>(steady_clock::now() - start);
+    log << "Allocated " << allocations.size() << " projects on day " << simulation_state.day << " in "
+        << elapsed.count() << " ms (" << nodes << " search nodes, "
+        << (uint64_t)(search_seconds > 0 ? nodes / search_seconds : 0) << " nodes/s).\n";
+
+    return allocations;
+}
+
+// Commits the allocation, hands the resulting state to evaluate and puts the state back as it was. Returns what
+// evaluate returned. The state only keeps logging changes afterwards if it did before
+template <typename Evaluate>
+auto what_if(const Data& data, SimulationState& simulation_state, const ProjectAllocation& allocation, Evaluate&& evaluate)
+{
+    bool kept_history = simulation_state.keeps_history();
+    auto snapshot = simulation_state.snapshot();
+    commit_allocation(data, simulation_state, allocation);
+    auto result = evaluate(simulation_state);
+    simulation_state.rollback(snapshot);
+    if (!kept_history)
+        simulation_state.forget_history();
+    return result;
+}
+
+// Runs the whole schedule from the given state until no contributor is busy and nothing more can be allocated, or until
+// the budget of the anytime mode is spent. after_day, if given, sees the state at the start of every new day
+inline SimulationState simulate_once(const Data& data, SimulationState simulation_state, const PortfolioOptions& options,
+                                     std::ostream& log = std::cout,
+                                     const std::function<void(const SimulationState&)>& after_day = {})
+{
+    PROFILE_SCOPE(Simulate);
+    // A run never rolls back, whatever the state it started from was logging
+    simulation_state.forget_history();
+    while (simulation_state.day != NMAX)
+    {
+        PROFILE_PERIODIC_STATS(log, simulation_state.day);
+        allocate_day(data, simulation_state, options, log);
+        if (options.budget && options.budget->spent())
+        {
+            log << "Time budget spent on day " << simulation_state.day << ", stopping with "
+                << simulation_state.proj_to_contrib.size() << " allocations" << std::endl;
+            break;
+        }
+
+        // Nothing more can be done at this day
+        simulation_state.pass_days();
+        log << "Passed day to " << simulation_state.day << std::endl;
+        if (after_day && simulation_state.day != NMAX)
+            after_day(simulation_state);
+    }
+    return simulation_state;
+}
+
+// simulate_once, and in the anytime mode, as long as a run ends before the budget does and some of its searches ran out
+// of time, another run from the same state with slices twice as long. Returns the run with the best score, which is
+// always a complete schedule up to the day it stopped on. Runs after the first only show after_day the days on which
+// they are ahead of the best run so far, so the last state it saw never scores less than the best one known then
+inline SimulationState simulate(const Data& data, const SimulationState& simulation_state, const PortfolioOptions& options,
+                                std::ostream& log = std::cout,
+                                const std::function<void(const SimulationState&)>& after_day = {})
+{
+    std::optional<SimulationState> best;
+    auto round_options = options;
+    std::function<void(const SimulationState&)> report_ahead;
+    if (after_day)
+        report_ahead = [&](const SimulationState& state){
+            if (!best || state.score_so_far > best->score_so_far)
+                after_day(state);
+        };
+    while (true)
+    {
+        auto run = simulate_once(data, simulation_state, round_options, log, report_ahead);
+        bool again = round_options.budget && !round_options.budget->spent() && run.search_memo.nr_timeouts();
+        if (!best || run.score_so_far > best->score_so_far)
+            best.emplace(std::move(run));
+        if (!again)
+            break;
+        round_options.budget->next_round();
+        log << "Budget left after a run scoring " << best->score_so_far << " so far, starting over with slices "
+            << round_options.budget->scale() << " times as long" << std::endl;
+    }
+    return std::move(*best);
+}
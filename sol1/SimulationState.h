@@ -1,86 +1,215 @@
 #pragma once
-#include <map>
-#include <cmath>
+#include <climits>
 #include <vector>
-#include <bitset>
+#include <ranges>
 
 #include "Data.h"
-#include "ProjectAllocator.h"
+#include "IndexedHeap.h"
+#include "Profiler.h"
+#include "ProjectQueue.h"
+#include "SearchMemo.h"
 
 #define NMAX 999999999
 
-using ProjectAllocation = std::pair<int, std::vector<std::string>>;
+using ProjectAllocation = std::pair<int, std::vector<uint32_t>>;
 
+// The schedule so far and everything derived from it. From the first snapshot on, every change to the schedule state
+// (day, score, allocations, availability, levels and done projects) goes to an undo log, so that a snapshot is a few
+// integers and rolling back costs as much as the changes it reverts. Lookahead can commit, look, and roll back instead
+// of copying the state; a worker that branches on its own copies the state once and then snapshots and rolls back as
+// much as it likes. forget_history stops the logging again, a state that is never snapshot logs nothing.
+//
+// The project queue and the memo of failed searches are caches of the schedule state and are not logged. Rolling back
+// keeps them sound: freed contributors count as releases for the memo, the projects done since the snapshot go back
+// to the queue along with the parked ones, and a rollback to an earlier day rebuilds the queue.
 struct SimulationState
 {
     const Data& data;
     int day, score_so_far;
     std::vector<ProjectAllocation> proj_to_contrib;
-    std::map<std::string, int> available_at;
-    std::map<std::string, std::set<std::string>[21]> skill_to_contributors;
-    std::bitset<MAX_PROJECTS> project_done;
+    // Indexed by contributor id
+    std::vector<int> available_at;
+    // Contributors with available_at <= day
+    Bitset available;
+    // Busy contributors keyed by the day they are released, the earliest on top
+    IndexedHeap<int> release_queue;
+    SkillMatrix skill_matrix;
+    std::vector<bool> project_done;
+    // Projects worth trying, kept across allocations and days
+    ProjectQueue project_queue;
+    // Failed searches that still hold
+    SearchMemo search_memo;
 
-    explicit SimulationState(const Data& data, const std::map<std::string, std::set<std::string>[21]>& skill_to_contributors)
+    // A point in the history of the state that rollback returns to
+    struct Snapshot
+    {
+        size_t nr_changes, nr_allocations;
+        int day, score_so_far;
+    };
+
+    explicit SimulationState(const Data& data, const SkillMatrix& skill_matrix)
             : day(0)
             , score_so_far(0)
             , data(data)
-            , skill_to_contributors(skill_to_contributors)
+            , available_at(data.nr_contributors, 0)
+            , available(data.nr_contributors)
+            , release_queue(data.nr_contributors)
+            , skill_matrix(skill_matrix)
+            , project_done(data.nr_projects, false)
+            , search_memo(data.nr_projects, skill_matrix.nr_skills)
+            , already_chosen(data.nr_contributors)
+            , level_stamp((size_t)skill_matrix.nr_skills * (MAX_LEVEL + 1), 0)
+            , available_count((size_t)skill_matrix.nr_skills * (MAX_LEVEL + 1), 0)
+            , skill_stamp(skill_matrix.nr_skills, 0)
+            , project_stamp(data.nr_projects, 0)
+    {
+        available.set_all();
+        rebuild_project_queue();
+    }
+
+    // Starts logging the changes if nothing is logged yet
+    [[nodiscard]] Snapshot snapshot()
     {
-        for (const auto& [skill, contribs_per_level] : skill_to_contributors)
+        keep_history = true;
+        return {undo_log.size(), proj_to_contrib.size(), day, score_so_far};
+    }
+
+    // Whether changes are logged, as they are from the first snapshot until forget_history
+    [[nodiscard]] bool keeps_history() const
+    {
+        return keep_history;
+    }
+
+    // Reverts every change made since the snapshot was taken. Snapshots taken after it are no longer valid
+    void rollback(const Snapshot& snapshot)
+    {
+        bool contributors_freed = false;
+        // Whoever did them took them out of the queue
+        std::vector<int> undone_projects;
+        while (undo_log.size() > snapshot.nr_changes)
         {
-            for (int i = 0; i <= 20; ++i)
+            const auto& [kind, id, skill_id, old_value] = undo_log.back();
+            switch (kind)
             {
-                const auto& contr_per_levels = skill_to_contributors.find(skill)->second;
-                if (contr_per_levels[i].empty())
-                    continue;
+                case Change::Kind::Busy:
+                    release_queue.erase(id);
+                    available_at[id] = old_value;
+                    available.set(id);
+                    search_memo.on_release(id, skill_matrix);
+                    contributors_freed = true;
+                    break;
+                case Change::Kind::Released:
+                    available.reset(id);
+                    release_queue.push(id, available_at[id]);
+                    break;
+                case Change::Kind::LevelUp:
+                    skill_matrix.set_level(id, skill_id, old_value);
+                    break;
+                case Change::Kind::Done:
+                    project_done[id] = false;
+                    undone_projects.push_back(id);
+                    break;
+            }
+            undo_log.pop_back();
+        }
+        proj_to_contrib.resize(snapshot.nr_allocations);
+        score_so_far = snapshot.score_so_far;
 
-                for (const auto& contrib_name : contr_per_levels[i])
-                    available_at[contrib_name] = 0;
+        if (day != snapshot.day)
+        {
+            day = snapshot.day;
+            rebuild_project_queue();
+        }
+        else
+        {
+            if (contributors_freed)
+            {
+                auto parked = project_queue.take_parked();
+                undone_projects.insert(undone_projects.end(), parked.begin(), parked.end());
             }
+            if (!undone_projects.empty())
+                requeue_projects(undone_projects);
         }
     }
 
+    // Drops the history and stops logging, which invalidates all snapshots
+    void forget_history()
+    {
+        undo_log.clear();
+        keep_history = false;
+    }
+
     void add_allocation(const ProjectAllocation& allocation)
     {
         proj_to_contrib.push_back(allocation);
-        const auto& [project_id, contributor_names] = allocation;
-        project_done[project_id] = true;
+        const auto& [project_id, contributor_ids] = allocation;
+        mark_done(project_id);
 
-        for (const auto& name : contributor_names)
+        for (const auto& contr_id : contributor_ids)
         {
-            available_at[name] = data.projects[project_id].length_in_days + day;
+            log_change(Change::Kind::Busy, contr_id, 0, available_at[contr_id]);
+            available_at[contr_id] = data.projects.length_in_days[project_id] + day;
+            available.reset(contr_id);
+            release_queue.push(contr_id, available_at[contr_id]);
         }
     }
 
+    // Jumps to the next day a contributor is released. Only the parked projects that the released contributors could
+    // make feasible are checked again
     void pass_days()
     {
-        int day_to_jump_to = NMAX;
-        for (const auto& [name, time] : available_at)
+        PROFILE_SCOPE(PassDays);
+        PROFILE_COUNT(DaysPassed, 1);
+        if (release_queue.empty())
+        {
+            day = NMAX;
+            return;
+        }
+
+        day = release_queue.top_key();
+        ++release_stamp;
+        while (!release_queue.empty() && release_queue.top_key() <= day)
         {
-            if (time > day && time < day_to_jump_to)
-                day_to_jump_to = time;
+            uint32_t contr_id = release_queue.pop();
+            available.set(contr_id);
+            log_change(Change::Kind::Released, contr_id, 0, 0);
+            search_memo.on_release(contr_id, skill_matrix);
+            for (const auto& [skill_id, level] : skill_matrix.skills_of_contributor(contr_id))
+                if (skill_stamp[skill_id] != release_stamp)
+                {
+                    skill_stamp[skill_id] = release_stamp;
+                    for (int project_index : data.projects.projects_with_skill(skill_id))
+                        project_stamp[project_index] = release_stamp;
+                }
         }
-        day = day_to_jump_to;
+
+        // Parked projects can only become feasible once someone is released. Someone without any of the skills of a
+        // project can only fill its roles of level 1, with mentoring
+        project_queue.advance_to(day);
+        requeue_projects(project_queue.take_parked_if([this](int project_index){
+            return project_stamp[project_index] == release_stamp || data.projects.has_level_one_role[project_index];
+        }));
     }
 
-    int heuristic_score(int project_index)
+    // Levels up the contributor in the skill, everything that depends on the levels follows
+    void level_up(uint32_t contr_id, uint32_t skill_id)
     {
-        const auto& project = data.projects[project_index];
-        int manpower_penalty = project.length_in_days * project.skill_to_level.size();
-        int day_penalty = (project.best_before_day > day + project.length_in_days)? 0 :
-                      day + project.length_in_days - project.best_before_day;
-        int ahead_of_time_penalty = std::max(0, project.best_before_day - project.length_in_days - day) * 3;
+        log_change(Change::Kind::LevelUp, contr_id, skill_id, skill_matrix.level(contr_id, skill_id));
+        skill_matrix.level_up(contr_id, skill_id);
+        search_memo.on_level_up(skill_id);
+    }
 
-        return std::max(0, ((int)std::pow(project.score, 2) - manpower_penalty - day_penalty - ahead_of_time_penalty));
+    // The project is allocated, or not worth allocating
+    void mark_done(int project_index)
+    {
+        log_change(Change::Kind::Done, (uint32_t)project_index, 0, 0);
+        project_done[project_index] = true;
     }
 
-    int actual_score(int project_index)
+    [[nodiscard]] int actual_score(int project_index) const
     {
-        const auto& project = data.projects[project_index];
-        int penalty = (project.best_before_day > day + project.length_in_days)? 0 :
-                day + project.length_in_days - project.best_before_day;
-        return std::max(0, (project.score - penalty));
-    };
+        return data.projects.actual_score(project_index, day);
+    }
 
     bool can_project_be_done(int project_index)
     {
@@ -88,48 +217,165 @@ struct SimulationState
         if (project_done[project_index])
             return false;
 
+        PROFILE_COUNT(CandidatesChecked, 1);
+        const auto roles = data.projects.roles(project_index);
+
         // At least one non-unique contributor who has that skill at >= level_req must be available
-        for (const auto& [curr_skill, level_req] : data.projects[project_index].skill_to_level)
+        for (const auto& [curr_skill, level_req] : roles)
+            if (!Bitset::intersects(skill_matrix.contributors_at_least(curr_skill, level_req), available))
+            {
+                PROFILE_COUNT(CandidatesFiltered, 1);
+                return false;
+            }
+
+        bool feasible = has_unique_candidates(roles);
+        PROFILE_COUNT(CandidatesFiltered, !feasible);
+        return feasible;
+    }
+
+    // Available contributors who could fill the tightest role of the project, with mentoring
+    [[nodiscard]] int feasibility_margin(int project_index) const
+    {
+        int margin = INT_MAX;
+        for (const auto& [curr_skill, level_req] : data.projects.roles(project_index))
+            margin = std::min<int>(margin, Bitset::count_common(skill_matrix.contributors_at_least(curr_skill, level_req - 1), available));
+        return margin;
+    }
+
+    // Same answer as can_project_be_done for every project in project_indices, appended to feasible in order.
+    // Availability counts per (skill, level) are computed once for the whole batch instead of once per role
+    template <typename ProjectIndices>
+    void collect_feasible_projects(const ProjectIndices& project_indices, std::vector<int>& feasible)
+    {
+        PROFILE_SCOPE(FeasibilityFilter);
+        // A new stamp invalidates all the counts cached by the previous batch
+        ++batch_stamp;
+        auto nr_available_at_least = [this](uint32_t skill_id, int level){
+            size_t index = (size_t)skill_id * (MAX_LEVEL + 1) + level;
+            if (level_stamp[index] != batch_stamp)
+            {
+                level_stamp[index] = batch_stamp;
+                available_count[index] = Bitset::count_common(skill_matrix.contributors_at_least(skill_id, level), available);
+            }
+            return available_count[index];
+        };
+
+        for (int project_index : project_indices)
         {
-            const auto& contr_per_levels = skill_to_contributors.find(curr_skill)->second;
-            bool ok = false;
-            for (int i = level_req; i <= 20; ++i)
+            if (project_done[project_index])
+                continue;
+
+            const auto roles = data.projects.roles(project_index);
+            bool ok = true, needs_unique_check = false;
+            for (uint32_t role_index = 0; role_index < roles.size(); ++role_index)
             {
-                for (const auto& contrib_name : contr_per_levels[i])
-                    if (available_at[contrib_name] <= day)
-                    {
-                        ok = true;
-                        break;
-                    }
-                if (ok)
+                const auto& [curr_skill, level_req] = roles[role_index];
+                if (!nr_available_at_least(curr_skill, level_req))
+                {
+                    ok = false;
                     break;
+                }
+                // The greedy pick below can only fail on a role if all of its candidates were taken by earlier roles
+                if (nr_available_at_least(curr_skill, level_req - 1) <= role_index)
+                    needs_unique_check = true;
             }
-            if (!ok)
-                return false;
+
+            PROFILE_COUNT(CandidatesChecked, 1);
+            if (ok && (!needs_unique_check || has_unique_candidates(roles)))
+                feasible.push_back(project_index);
+            else
+                PROFILE_COUNT(CandidatesFiltered, 1);
         }
+    }
+
+    // Queues the feasible projects among candidates, and parks the others until contributors get released
+    void requeue_projects(const std::vector<int>& candidates)
+    {
+        std::vector<int> feasible;
+        collect_feasible_projects(candidates, feasible);
 
+        auto next_feasible = feasible.begin();
+        for (int project_index : candidates)
+        {
+            if (next_feasible != feasible.end() && *next_feasible == project_index)
+            {
+                project_queue.push(project_index, day);
+                ++next_feasible;
+            }
+            else if (!project_done[project_index])
+                project_queue.park(project_index);
+        }
+    }
+
+    // Queues every project not done yet as if the simulation had started on the current day.
+    // Needed after the day, availability or done projects were set from outside
+    void rebuild_project_queue()
+    {
+        project_queue = ProjectQueue(data.projects);
+        project_queue.advance_to(day);
+        auto all_projects = std::views::iota(0, data.nr_projects);
+        requeue_projects(std::vector<int>(all_projects.begin(), all_projects.end()));
+    }
+
+private:
+    // One change to the schedule state, with what is needed to revert it
+    struct Change
+    {
+        enum class Kind : uint8_t { Busy, Released, LevelUp, Done };
+        Kind kind;
+        // Contributor id, or project index for Done
+        uint32_t id;
+        uint32_t skill_id;
+        // available_at before Busy, level before LevelUp
+        int old_value;
+    };
+
+    std::vector<Change> undo_log;
+    bool keep_history = false;
+    Bitset already_chosen;
+    uint32_t batch_stamp = 0;
+    std::vector<uint32_t> level_stamp, available_count;
+    // The skills of the contributors freed by the last pass_days, and the projects with roles in them, are stamped with
+    // release_stamp
+    uint32_t release_stamp = 0;
+    std::vector<uint32_t> skill_stamp, project_stamp;
+
+    void log_change(Change::Kind kind, uint32_t id, uint32_t skill_id, int old_value)
+    {
+        if (keep_history)
+            undo_log.push_back({kind, id, skill_id, old_value});
+    }
+
+    bool has_unique_candidates(std::span<const SkillToLevel> roles)
+    {
         // At least one unique contributor who has that skill at >= level_req - 1 must be available
-        std::set<std::string> contr_already_chosen;
-        for (const auto& [curr_skill, level_req] : data.projects[project_index].skill_to_level)
+        already_chosen.clear();
+        for (const auto& [curr_skill, level_req] : roles)
         {
-            const auto& contr_per_levels = skill_to_contributors.find(curr_skill)->second;
-            bool ok = false;
+            // Pick the lowest level candidate first, then the lowest id
+            uint32_t chosen = Bitset::npos;
+            if (level_req - 1 == 0)
+                chosen = skill_matrix.first_available_at(curr_skill, 0, available, already_chosen);
 
-            for (int i = level_req - 1; i <= 20; ++i)
+            if (chosen == Bitset::npos)
             {
-                for (const auto& contrib_name : contr_per_levels[i])
-                    if (available_at[contrib_name] <= day && !contr_already_chosen.contains(contrib_name))
+                int chosen_level = MAX_LEVEL + 1;
+                for (const auto& [contr_id, level] : skill_matrix.skilled_contributors(curr_skill))
+                {
+                    if (level < level_req - 1 || !available.test(contr_id) || already_chosen.test(contr_id))
+                        continue;
+                    if (level < chosen_level || (level == chosen_level && contr_id < chosen))
                     {
-                        ok = true;
-                        contr_already_chosen.insert(contrib_name);
-                        break;
+                        chosen = contr_id;
+                        chosen_level = level;
                     }
-                if (ok)
-                    break;
+                }
             }
-            if (!ok)
+
+            if (chosen == Bitset::npos)
                 return false;
+            already_chosen.set(chosen);
         }
         return true;
     }
-};
\ No newline at end of file
+};
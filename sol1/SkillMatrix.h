@@ -0,0 +1,195 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "Bitset.h"
+
+#define MAX_LEVEL 20
+
+// How a SkillMatrix stores its levels and bitsets
+enum class SkillLayout
+{
+    // Dense below DENSE_BUDGET bytes, sparse above
+    Auto,
+    Dense,
+    Sparse
+};
+
+// Contributor x skill table of levels, plus, for every (skill, level) pair, the bitset of contributors
+// having exactly that level and the bitset of contributors having at least that level.
+//
+// The dense layout holds one byte per (contributor, skill) and every bitset in full, about 6.5 bytes per cell. The
+// sparse layout keeps the levels of each contributor in a short list and only the non-zero words of the bitsets, so
+// its size follows the number of skill entries instead of the number of cells, and the searches skip the empty words.
+// Level 0 of a skill is then not stored at all: it is everyone without the skill, see word_at. Both layouts give the
+// same answers, and the sparse one is no slower on the problem inputs
+class SkillMatrix
+{
+public:
+    // Size of the dense layout above which Auto picks the sparse one. Every simulation state holds a copy
+    static constexpr size_t DENSE_BUDGET = size_t(64) << 20;
+
+    uint32_t nr_contributors = 0, nr_skills = 0;
+
+    SkillMatrix() = default;
+
+    SkillMatrix(uint32_t nr_contributors, uint32_t nr_skills, SkillLayout layout = SkillLayout::Auto)
+            : nr_contributors(nr_contributors)
+            , nr_skills(nr_skills)
+            , sparse(layout == SkillLayout::Sparse ||
+                     (layout == SkillLayout::Auto && dense_size(nr_contributors, nr_skills) > DENSE_BUDGET))
+            , levels(sparse ? 0 : (size_t)nr_contributors * nr_skills, 0)
+            , at_level((size_t)nr_skills * (MAX_LEVEL + 1), Bitset(nr_contributors, sparse))
+            , at_least((size_t)nr_skills * (MAX_LEVEL + 1), Bitset(nr_contributors, sparse))
+            , skilled(nr_skills)
+            , skills_of(nr_contributors)
+            , everyone(nr_contributors)
+    {
+        // Everyone starts at level 0 in every skill. Having at least level 0 never changes, so all the skills share
+        // one bitset for it
+        everyone.set_all();
+        if (!sparse)
+            for (uint32_t skill_id = 0; skill_id < nr_skills; ++skill_id)
+                bucket(at_level, skill_id, 0) = everyone;
+    }
+
+    // Bytes the dense layout needs for these dimensions
+    [[nodiscard]] static size_t dense_size(uint32_t nr_contributors, uint32_t nr_skills)
+    {
+        size_t nr_bitsets = (size_t)nr_skills * (MAX_LEVEL + 1) * 2;
+        return (size_t)nr_contributors * nr_skills + nr_bitsets * ((nr_contributors + 63) / 64 * 8 + sizeof(Bitset));
+    }
+
+    [[nodiscard]] bool is_sparse() const
+    {
+        return sparse;
+    }
+
+    [[nodiscard]] int level(uint32_t contr_id, uint32_t skill_id) const
+    {
+        if (!sparse)
+            return levels[(size_t)contr_id * nr_skills + skill_id];
+        for (const auto& [skill, level] : skills_of[contr_id])
+            if (skill == skill_id)
+                return level;
+        return 0;
+    }
+
+    [[nodiscard]] bool has_skill_at_level(uint32_t contr_id, uint32_t skill_id, int level_req) const
+    {
+        return level(contr_id, skill_id) >= level_req;
+    }
+
+    // Contributors having the skill at exactly this level. Not stored for level 0 of a sparse matrix, which word_at
+    // and first_available_at answer instead
+    [[nodiscard]] const Bitset& contributors_at(uint32_t skill_id, int level) const
+    {
+        return at_level[(size_t)skill_id * (MAX_LEVEL + 1) + level];
+    }
+
+    // Contributors having the skill at this level or higher
+    [[nodiscard]] const Bitset& contributors_at_least(uint32_t skill_id, int level) const
+    {
+        if (level <= 0)
+            return everyone;
+        return at_least[(size_t)skill_id * (MAX_LEVEL + 1) + level];
+    }
+
+    // Word word_index of contributors_at(skill_id, level), in either layout
+    [[nodiscard]] uint64_t word_at(uint32_t skill_id, int level, uint32_t word_index) const
+    {
+        if (level == 0 && sparse)
+            return everyone.data()[word_index] & ~contributors_at_least(skill_id, 1).word(word_index);
+        return contributors_at(skill_id, level).word(word_index);
+    }
+
+    // First word from word_index on where contributors_at(skill_id, level) is not zero, or may not be
+    [[nodiscard]] uint32_t next_word_at(uint32_t skill_id, int level, uint32_t word_index) const
+    {
+        if (level == 0 && sparse)
+            return word_index;
+        return contributors_at(skill_id, level).next_word(word_index);
+    }
+
+    // Lowest contributor id at exactly this level that is in available and not in excluded, Bitset::npos if none
+    [[nodiscard]] uint32_t first_available_at(uint32_t skill_id, int level, const Bitset& available, const Bitset& excluded) const
+    {
+        if (level != 0 || !sparse)
+            return Bitset::first_common(contributors_at(skill_id, level), available, excluded);
+        for (uint32_t word_index = 0; word_index < available.nr_words(); ++word_index)
+            if (uint64_t word = word_at(skill_id, 0, word_index) & available.data()[word_index] & ~excluded.data()[word_index])
+                return (word_index << 6) | std::countr_zero(word);
+        return Bitset::npos;
+    }
+
+    // (contributor, level) for everyone having the skill at level 1 or higher, in no particular order.
+    // Usually a handful per skill, so scanning it is cheaper than scanning the bitsets
+    [[nodiscard]] const std::vector<std::pair<uint32_t, int>>& skilled_contributors(uint32_t skill_id) const
+    {
+        return skilled[skill_id];
+    }
+
+    // (skill, level) for every skill the contributor has at level 1 or higher, in no particular order
+    [[nodiscard]] const std::vector<std::pair<uint32_t, int>>& skills_of_contributor(uint32_t contr_id) const
+    {
+        return skills_of[contr_id];
+    }
+
+    void set_level(uint32_t contr_id, uint32_t skill_id, int new_level)
+    {
+        // Levels above the highest one ever required behave the same
+        new_level = std::min(new_level, MAX_LEVEL);
+        int old_level = level(contr_id, skill_id);
+
+        // Level 0 of a sparse matrix is implied by the other levels
+        if (old_level || !sparse)
+            bucket(at_level, skill_id, old_level).reset(contr_id);
+        if (new_level || !sparse)
+            bucket(at_level, skill_id, new_level).set(contr_id);
+        for (int lvl = old_level + 1; lvl <= new_level; ++lvl)
+            bucket(at_least, skill_id, lvl).set(contr_id);
+        for (int lvl = new_level + 1; lvl <= old_level; ++lvl)
+            bucket(at_least, skill_id, lvl).reset(contr_id);
+
+        update_entry(skilled[skill_id], contr_id, new_level);
+        update_entry(skills_of[contr_id], skill_id, new_level);
+        if (!sparse)
+            levels[(size_t)contr_id * nr_skills + skill_id] = new_level;
+    }
+
+    void level_up(uint32_t contr_id, uint32_t skill_id)
+    {
+        set_level(contr_id, skill_id, level(contr_id, skill_id) + 1);
+    }
+
+private:
+    bool sparse = false;
+    // Dense layout only
+    std::vector<uint8_t> levels;
+    std::vector<Bitset> at_level, at_least;
+    std::vector<std::vector<std::pair<uint32_t, int>>> skilled, skills_of;
+    Bitset everyone;
+
+    static Bitset& bucket(std::vector<Bitset>& buckets, uint32_t skill_id, int level)
+    {
+        return buckets[(size_t)skill_id * (MAX_LEVEL + 1) + level];
+    }
+
+    // Sets the level of id in a list of (id, level) with levels of 1 or higher
+    static void update_entry(std::vector<std::pair<uint32_t, int>>& entries, uint32_t id, int new_level)
+    {
+        auto it = std::find_if(entries.begin(), entries.end(), [id](const auto& entry){
+            return entry.first == id;
+        });
+        if (it == entries.end())
+        {
+            if (new_level)
+                entries.emplace_back(id, new_level);
+        }
+        else if (new_level)
+            it->second = new_level;
+        else
+            entries.erase(it);
+    }
+};
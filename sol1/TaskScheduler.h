@@ -0,0 +1,214 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Profiler.h"
+
+// Persistent pool of worker threads, one per hardware thread. Every worker owns a deque of tasks: it takes work from
+// the back of its own deque and, once that is empty, steals from the front of the others. Tasks submitted from
+// outside the pool are spread over the deques round robin.
+class TaskScheduler
+{
+public:
+    using Task = std::function<void()>;
+
+    explicit TaskScheduler(unsigned nr_workers = std::max(1u, std::thread::hardware_concurrency()))
+    {
+        for (unsigned index = 0; index < nr_workers; ++index)
+            queues.push_back(std::make_unique<WorkQueue>());
+        for (unsigned index = 0; index < nr_workers; ++index)
+            workers.emplace_back([this, index](){ worker_loop(index); });
+    }
+
+    ~TaskScheduler()
+    {
+        {
+            std::lock_guard lock(sleep_mutex);
+            stopping = true;
+        }
+        wake_up.notify_all();
+        for (auto& worker : workers)
+            worker.join();
+    }
+
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    // Pool shared by the whole process
+    static TaskScheduler& global()
+    {
+        static TaskScheduler scheduler(global_size());
+        return scheduler;
+    }
+
+    // Number of workers of the global pool, only has an effect before its first use
+    static void set_global_size(unsigned nr_workers)
+    {
+        global_size() = std::max(1u, nr_workers);
+    }
+
+    [[nodiscard]] unsigned size() const
+    {
+        return workers.size();
+    }
+
+    void submit(Task task)
+    {
+        unsigned target = (owner == this) ? current_worker : next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+        {
+            std::lock_guard lock(queues[target]->mutex);
+            queues[target]->tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard lock(sleep_mutex);
+            ++pending;
+        }
+        wake_up.notify_one();
+    }
+
+    // Runs one queued task on the calling thread if there is any, so that threads waiting for results help out
+    bool run_one()
+    {
+        Task task;
+        unsigned first = (owner == this) ? current_worker : next_queue.load(std::memory_order_relaxed) % queues.size();
+        if (!take(first, task))
+            return false;
+        task();
+        return true;
+    }
+
+private:
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<unsigned> next_queue = 0;
+
+    std::mutex sleep_mutex;
+    std::condition_variable wake_up;
+    size_t pending = 0;
+    bool stopping = false;
+
+    static unsigned& global_size()
+    {
+        static unsigned nr_workers = std::max(1u, std::thread::hardware_concurrency());
+        return nr_workers;
+    }
+
+    // Which pool and which worker the current thread belongs to, if any
+    static inline thread_local TaskScheduler* owner = nullptr;
+    static inline thread_local unsigned current_worker = 0;
+
+    // Own deque from the back first, then steal from the front of the others
+    bool take(unsigned own, Task& task)
+    {
+        for (unsigned offset = 0; offset < queues.size(); ++offset)
+        {
+            auto& queue = *queues[(own + offset) % queues.size()];
+            std::lock_guard lock(queue.mutex);
+            if (queue.tasks.empty())
+                continue;
+
+            if (offset == 0)
+            {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            }
+            else
+            {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+
+            std::lock_guard sleep_lock(sleep_mutex);
+            --pending;
+            return true;
+        }
+        return false;
+    }
+
+    void worker_loop(unsigned index)
+    {
+        owner = this;
+        current_worker = index;
+        PROFILE_THREAD_NAME("worker " + std::to_string(index));
+        while (true)
+        {
+            Task task;
+            if (take(index, task))
+            {
+                PROFILE_TIME_INTO(WorkerBusyNs);
+                task();
+                continue;
+            }
+
+            PROFILE_TIME_INTO(WorkerIdleNs);
+            std::unique_lock lock(sleep_mutex);
+            wake_up.wait(lock, [this](){ return stopping || pending > 0; });
+            if (stopping)
+                return;
+        }
+    }
+};
+
+// Set of tasks that can be waited for together. The waiting thread runs queued tasks instead of idling
+class TaskGroup
+{
+public:
+    explicit TaskGroup(TaskScheduler& scheduler = TaskScheduler::global())
+            : scheduler(scheduler)
+    {}
+
+    ~TaskGroup()
+    {
+        wait();
+    }
+
+    void run(std::function<void()> task)
+    {
+        {
+            std::lock_guard lock(mutex);
+            ++remaining;
+        }
+        scheduler.submit([this, task = std::move(task)](){
+            task();
+            std::lock_guard lock(mutex);
+            if (--remaining == 0)
+                done.notify_all();
+        });
+    }
+
+    void wait()
+    {
+        while (true)
+        {
+            {
+                std::lock_guard lock(mutex);
+                if (!remaining)
+                    return;
+            }
+            if (scheduler.run_one())
+                continue;
+
+            std::unique_lock lock(mutex);
+            done.wait_for(lock, std::chrono::milliseconds(1), [this](){ return !remaining; });
+        }
+    }
+
+private:
+    TaskScheduler& scheduler;
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t remaining = 0;
+};
@@ -0,0 +1,67 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+
+// One wall-clock budget for the whole simulation of an input, for the anytime mode. Every search gets a slice of what
+// is left: the time still remaining spread evenly over the projects still open, so time saved by quick searches goes to
+// the later ones, then weighted by how hard the search looks:
+// - more roles than average means a larger search space, and more time
+// - every timeout of the project so far halves its time, a search that ran out once is likely to run out again
+// - a feasibility margin below the role count, fewer available contributors for the tightest role than there are
+//   roles, is typical of the projects the prefilter lets through although they cannot be done, so they get less time
+// Once the budget is spent the simulation stops, everything allocated until then is a valid schedule. Splitting over
+// the open projects leaves budget over on inputs where most of them never get searched, so a run that ends early is
+// followed by another one with slices twice as long, see simulate.
+class TimeBudget
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    // Shortest slice worth starting a search for
+    static constexpr clock::duration MIN_SLICE = std::chrono::milliseconds(1);
+
+    explicit TimeBudget(clock::duration total)
+            : end(clock::now() + total)
+    {}
+
+    [[nodiscard]] clock::duration remaining() const
+    {
+        return std::max(clock::duration::zero(), end - clock::now());
+    }
+
+    // How many times longer the slices are than in the first run
+    [[nodiscard]] double scale() const
+    {
+        return slice_scale;
+    }
+
+    void next_round()
+    {
+        slice_scale *= 2;
+    }
+
+    [[nodiscard]] bool spent() const
+    {
+        return remaining() < MIN_SLICE;
+    }
+
+    // Time one search may take now, never more than cap or than what is left. nr_in_flight searches run side by side,
+    // so each of them may take that many shares of the wall clock
+    [[nodiscard]] clock::duration slice(int nr_roles, double average_roles, int nr_timeouts, int margin,
+                                        int nr_open_projects, int nr_in_flight, clock::duration cap) const
+    {
+        auto left = remaining();
+        double weight = nr_roles / std::max(1.0, average_roles);
+        weight /= double(1u << std::min(nr_timeouts, 16));
+        if (margin < nr_roles)
+            weight *= double(margin) / nr_roles;
+
+        std::chrono::duration<double> share = left * nr_in_flight / std::max(1, nr_open_projects);
+        auto slice = std::chrono::duration_cast<clock::duration>(share * weight * slice_scale);
+        return std::min({std::max(slice, MIN_SLICE), cap, left});
+    }
+
+private:
+    clock::time_point end;
+    double slice_scale = 1;
+};
@@ -0,0 +1,247 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "Data.h"
+#include "MappedFile.h"
+
+// Outcome of replaying a schedule
+struct ValidationResult
+{
+    bool valid = true;
+    // Why the schedule is invalid, empty if it is valid
+    std::string error;
+    int64_t score = 0;
+    int skill_increase = 0;
+    // Allocations replayed before the first invalid one, all of them for a valid schedule
+    size_t nr_valid = 0;
+};
+
+// Replays a schedule of project allocations on the input: checks that every contributor can fill their role, possibly
+// with a mentor on the team, applies the level-ups and adds up the score.
+//
+// The default timing follows validate.py, where every project counts as started on day 0. The strict timing starts
+// every project once all of its contributors finished their previous one, and also rejects teams with a contributor
+// twice or with a different number of contributors than roles.
+//
+// Levels are read from the input, with the level-ups of the current replay kept on the side and dropped afterwards, so
+// the same validator can rescore many candidate schedules cheaply, and costs nothing per contributor x skill
+class Validator
+{
+public:
+    enum class Timing
+    {
+        // Same rules as validate.py
+        Reference,
+        Strict
+    };
+
+    explicit Validator(const Data& data)
+            : data(data)
+            , nr_skills(data.skills.size())
+            , busy_until(data.contributors.size(), 0)
+            , team_stamp(data.contributors.size(), 0)
+            , project_stamp(data.projects.size(), 0)
+    {
+        for (int project_index = 0; project_index < data.projects.size(); ++project_index)
+            project_ids.emplace(data.projects.name[project_index], project_index);
+    }
+
+    ValidationResult validate(const std::vector<ProjectAllocation>& schedule, Timing timing = Timing::Reference)
+    {
+        ValidationResult result;
+        ++stamp;
+        int simulation_day = 0;
+        if (timing == Timing::Strict)
+            std::fill(busy_until.begin(), busy_until.end(), 0);
+
+        for (const auto& [project_index, contributor_ids] : schedule)
+        {
+            const auto& projects = data.projects;
+            const auto roles = projects.roles(project_index);
+            const auto project_name = std::string(projects.name[project_index]);
+            if (project_stamp[project_index] == stamp)
+            {
+                fail(result, "project " + project_name + " appears twice");
+                break;
+            }
+            project_stamp[project_index] = stamp;
+
+            if (contributor_ids.size() > roles.size() ||
+                (timing == Timing::Strict && contributor_ids.size() != roles.size()))
+            {
+                fail(result, "project " + project_name + " has " + std::to_string(roles.size()) +
+                             " roles but " + std::to_string(contributor_ids.size()) + " contributors");
+                break;
+            }
+
+            // The project can be started once all involved contributors finished their previous project
+            int starting_day = 0;
+            if (timing == Timing::Strict)
+            {
+                for (uint32_t contr_id : contributor_ids)
+                {
+                    if (team_stamp[contr_id] == stamp_for(project_index))
+                    {
+                        fail(result, "contributor " + std::string(data.contributors.names[contr_id]) +
+                                     " appears twice in project " + project_name);
+                        break;
+                    }
+                    team_stamp[contr_id] = stamp_for(project_index);
+                    starting_day = std::max(starting_day, busy_until[contr_id]);
+                }
+                if (!result.valid)
+                    break;
+                simulation_day = starting_day;
+            }
+            else
+                simulation_day = std::max(simulation_day, starting_day);
+
+            // Check that every contributor can fill their role. Mentees level up right away, like in validate.py, so a
+            // mentee can mentor a later role of the same project
+            for (size_t role = 0; role < contributor_ids.size() && result.valid; ++role)
+            {
+                uint32_t contr_id = contributor_ids[role];
+                const auto& [skill_id, level_req] = roles[role];
+                int level = level_of(contr_id, skill_id);
+                if (level < level_req - 1)
+                    fail(result, "contributor " + std::string(data.contributors.names[contr_id]) +
+                                 " cannot fill role " + std::to_string(role) + " of project " + project_name);
+                else if (level == level_req - 1)
+                {
+                    // Contributor requires mentorship
+                    bool has_mentor = std::any_of(contributor_ids.begin(), contributor_ids.end(), [&](uint32_t other){
+                        return level_of(other, skill_id) >= level_req;
+                    });
+                    if (!has_mentor)
+                        fail(result, "nobody can mentor contributor " + std::string(data.contributors.names[contr_id]) +
+                                     " in role " + std::to_string(role) + " of project " + project_name);
+                    else
+                    {
+                        level_up(contr_id, skill_id);
+                        result.skill_increase++;
+                    }
+                }
+            }
+            if (!result.valid)
+                break;
+
+            if (timing == Timing::Strict)
+                for (uint32_t contr_id : contributor_ids)
+                    busy_until[contr_id] = simulation_day + projects.length_in_days[project_index];
+
+            // Score the project
+            result.score += projects.actual_score(project_index, simulation_day);
+            ++result.nr_valid;
+        }
+
+        // Back to the levels of the input for the next replay
+        raised_levels.clear();
+        return result;
+    }
+
+    // Reads an output file, mapping the names back to ids. Unknown names and malformed files are reported in error
+    std::vector<ProjectAllocation> read_solution(const std::string& filename, std::string& error) const
+    {
+        std::vector<ProjectAllocation> schedule;
+        MappedFile solution(filename);
+        auto text = solution.view();
+
+        auto next_line = [&text](){
+            auto end = std::min(text.find('\n'), text.size());
+            auto line = text.substr(0, end);
+            text.remove_prefix(std::min(end + 1, text.size()));
+            return line;
+        };
+
+        int nr_planned = 0;
+        try
+        {
+            nr_planned = Tokenizer(next_line()).next_int();
+        }
+        catch (const std::runtime_error& exception)
+        {
+            error = exception.what();
+            return schedule;
+        }
+
+        schedule.reserve(nr_planned);
+        for (int index = 0; index < nr_planned; ++index)
+        {
+            auto project_name = Tokenizer(next_line()).next_word();
+            auto project_it = project_ids.find(project_name);
+            if (project_it == project_ids.end())
+            {
+                error = "unknown project '" + std::string(project_name) + "'";
+                return schedule;
+            }
+
+            auto& [project_index, contributor_ids] = schedule.emplace_back(project_it->second, std::vector<uint32_t>{});
+            Tokenizer contributors(next_line());
+            for (auto name = contributors.next_word(); !name.empty(); name = contributors.next_word())
+            {
+                auto contr_it = data.contributors.ids.find(name);
+                if (contr_it == data.contributors.ids.end())
+                {
+                    error = "unknown contributor '" + std::string(name) + "'";
+                    return schedule;
+                }
+                contributor_ids.push_back(contr_it->second);
+            }
+        }
+        return schedule;
+    }
+
+    // 1234567 -> "1,234,567", like Python's "{:,}"
+    static std::string with_thousands_separators(int64_t value)
+    {
+        std::string digits = std::to_string(value < 0 ? -value : value);
+        std::string formatted;
+        for (size_t index = 0; index < digits.size(); ++index)
+        {
+            if (index && (digits.size() - index) % 3 == 0)
+                formatted += ',';
+            formatted += digits[index];
+        }
+        return value < 0 ? "-" + formatted : formatted;
+    }
+
+private:
+    const Data& data;
+    const uint32_t nr_skills;
+    std::unordered_map<std::string_view, int> project_ids;
+
+    // Scratch space of a replay
+    std::vector<int> busy_until;
+    std::vector<uint64_t> team_stamp, project_stamp;
+    // Levels raised by the replay, by contr_id * nr_skills + skill_id. The others are still those of the input
+    std::unordered_map<uint64_t, uint8_t> raised_levels;
+    uint64_t stamp = 0;
+
+    [[nodiscard]] int level_of(uint32_t contr_id, uint32_t skill_id) const
+    {
+        auto it = raised_levels.find((uint64_t)contr_id * nr_skills + skill_id);
+        return it != raised_levels.end() ? it->second : data.skill_matrix.level(contr_id, skill_id);
+    }
+
+    void level_up(uint32_t contr_id, uint32_t skill_id)
+    {
+        raised_levels[(uint64_t)contr_id * nr_skills + skill_id] = std::min(level_of(contr_id, skill_id) + 1, MAX_LEVEL);
+    }
+
+    // Unique per (replay, project), so that team membership needs no clearing between projects
+    [[nodiscard]] uint64_t stamp_for(int project_index) const
+    {
+        return stamp * data.projects.size() + project_index + 1;
+    }
+
+    static void fail(ValidationResult& result, std::string error)
+    {
+        result.valid = false;
+        result.error = std::move(error);
+    }
+};
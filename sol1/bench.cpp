@@ -0,0 +1,469 @@
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Data.h"
+#include "Generator.h"
+#include "ScheduleOptimizer.h"
+#include "Simulation.h"
+#include "Validator.h"
+
+#ifdef SOL1_HAVE_BENCHMARK
+#include <benchmark/benchmark.h>
+#endif
+
+// Benchmarks for sol1.
+//
+//   sol1_bench generate <output> [--contributors N] [--projects N] [--skills N] [--roles N] [--levels N] [--seed N]
+//       Writes a synthetic instance, see Generator.h
+//   sol1_bench e2e [--engine backtracking|matcher] [--policy first|learning] [--time-limit MS] [--budget MS]
+//                  [--seed N] [--optimize MS] [--threads N] [--large] [inputs...]
+//       Solves every input in its own process and prints wall time, CPU time, score and peak RSS per input as JSON.
+//       --budget runs the simulation in the anytime mode with that budget. --optimize runs the schedule optimizer
+//       for that long after the simulation, on N threads. --large forces the sparse skill layout, which large inputs
+//       get anyway.
+//       Without inputs, the six files under ../../input_files/ are solved
+//   sol1_bench micro [--instance <input>] [Google Benchmark flags]
+//       Micro benchmarks on a generated instance about the size of f, or on the given input
+
+namespace
+{
+
+struct EndToEndSettings
+{
+    SearchEngine engine = SearchEngine::Backtracking;
+    PortfolioPolicy policy = PortfolioPolicy::FirstFound;
+    std::optional<uint64_t> seed;
+    std::optional<milliseconds> time_limit;
+    std::optional<milliseconds> budget;
+    std::optional<milliseconds> optimize;
+    // Optimizer threads, 0 for one per core
+    int nr_threads = 0;
+    SkillLayout skill_layout = SkillLayout::Auto;
+};
+
+struct EndToEndResult
+{
+    double wall_seconds = 0, cpu_seconds = 0;
+    // Score of the simulation alone, before the optimizer
+    int64_t greedy_score = 0;
+    int64_t score = 0;
+    int skill_increase = 0;
+    int projects_done = 0;
+    bool valid = false;
+};
+
+std::string json_escape(const std::string& text)
+{
+    std::string escaped;
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+            escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+// Solves the input in a child process, so that the peak RSS is the one of this input alone. The scheduler threads are
+// only started in the child, as they would not survive the fork
+bool run_end_to_end(const std::string& input, const EndToEndSettings& settings, EndToEndResult& result, long& peak_rss_kb)
+{
+    int channel[2];
+    if (pipe(channel) < 0)
+        return false;
+
+    // Whatever is still buffered would be written out by the child too
+    std::cout.flush();
+    std::fflush(stdout);
+    pid_t child = fork();
+    if (child < 0)
+        return false;
+    if (child == 0)
+    {
+        close(channel[0]);
+        // The simulation log is not part of the report
+        std::freopen("/dev/null", "w", stdout);
+
+        auto options = PortfolioOptions::sized_to(TaskScheduler::global(), settings.engine, settings.policy);
+        options.seed = settings.seed;
+        if (settings.time_limit)
+            options.time_limit = *settings.time_limit;
+
+        EndToEndResult child_result;
+        auto start = steady_clock::now();
+        Data data(input, settings.skill_layout);
+        if (settings.budget)
+            options.budget = TimeBudget(*settings.budget);
+        SimulationState base_simulation(data, data.skill_matrix);
+        auto schedule = simulate(data, base_simulation, options).proj_to_contrib;
+        Validator validator(data);
+        child_result.greedy_score = validator.validate(schedule, Validator::Timing::Strict).score;
+        // The optimizer keeps dense level tables
+        if (settings.optimize && !data.skill_matrix.is_sparse())
+        {
+            OptimizerOptions optimizer_options;
+            optimizer_options.time_limit = *settings.optimize;
+            if (settings.seed)
+                optimizer_options.seed = *settings.seed;
+            TaskScheduler optimizer_scheduler(settings.nr_threads > 0 ? (unsigned)settings.nr_threads
+                                                                      : std::max(1u, std::thread::hardware_concurrency()));
+            schedule = ScheduleOptimizer::optimize(data, schedule, optimizer_options, optimizer_scheduler).schedule;
+        }
+        child_result.wall_seconds = duration<double>(steady_clock::now() - start).count();
+
+        auto validation = validator.validate(schedule, Validator::Timing::Strict);
+        child_result.score = validation.score;
+        child_result.skill_increase = validation.skill_increase;
+        child_result.projects_done = schedule.size();
+        child_result.valid = validation.valid;
+
+        bool written = write(channel[1], &child_result, sizeof(child_result)) == sizeof(child_result);
+        _exit(written ? 0 : 1);
+    }
+
+    close(channel[1]);
+    bool received = read(channel[0], &result, sizeof(result)) == sizeof(result);
+    close(channel[0]);
+
+    int status = 0;
+    rusage usage{};
+    wait4(child, &status, 0, &usage);
+    peak_rss_kb = usage.ru_maxrss;
+    result.cpu_seconds = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+                         (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+    return received && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+int end_to_end(const std::vector<std::string>& args)
+{
+    EndToEndSettings settings;
+    std::vector<std::string> inputs;
+
+    for (size_t index = 0; index < args.size(); ++index)
+    {
+        const auto& arg = args[index];
+        bool has_value = index + 1 < args.size();
+        try
+        {
+            if (arg == "--engine" && has_value && parse_search_engine(args[index + 1], settings.engine))
+                ++index;
+            else if (arg == "--policy" && has_value && parse_portfolio_policy(args[index + 1], settings.policy))
+                ++index;
+            else if (arg == "--time-limit" && has_value)
+                settings.time_limit = milliseconds(std::stoll(args[++index]));
+            else if (arg == "--budget" && has_value)
+                settings.budget = milliseconds(std::stoll(args[++index]));
+            else if (arg == "--seed" && has_value)
+                settings.seed = std::stoull(args[++index]);
+            else if (arg == "--optimize" && has_value)
+                settings.optimize = milliseconds(std::stoll(args[++index]));
+            else if (arg == "--threads" && has_value)
+                settings.nr_threads = std::stoi(args[++index]);
+            else if (arg == "--large")
+                settings.skill_layout = SkillLayout::Sparse;
+            else if (arg.starts_with("--"))
+            {
+                std::cerr << "Unknown option " << arg << "\n";
+                return 2;
+            }
+            else
+                inputs.push_back(arg);
+        }
+        catch (const std::logic_error&)
+        {
+            std::cerr << "Invalid value for " << arg << "\n";
+            return 2;
+        }
+    }
+
+    if (inputs.empty())
+        for (const auto& input_file : {"a_an_example", "b_better_start_small", "c_collaboration",
+                                       "d_dense_schedule", "e_exceptional_skills", "f_find_great_mentors"})
+            inputs.push_back(std::string("../../input_files/") + input_file + ".in");
+
+    int exit_code = 0;
+    std::cout << "[\n";
+    for (size_t index = 0; index < inputs.size(); ++index)
+    {
+        EndToEndResult result;
+        long peak_rss_kb = 0;
+        bool ok = run_end_to_end(inputs[index], settings, result, peak_rss_kb);
+        if (!ok || !result.valid)
+            exit_code = 1;
+
+        std::cout << "  {\"input\": \"" << json_escape(inputs[index]) << "\", "
+                  << "\"ok\": " << (ok && result.valid ? "true" : "false") << ", "
+                  << "\"wall_seconds\": " << result.wall_seconds << ", "
+                  << "\"cpu_seconds\": " << result.cpu_seconds << ", "
+                  << "\"greedy_score\": " << result.greedy_score << ", "
+                  << "\"score\": " << result.score << ", "
+                  << "\"skill_increase\": " << result.skill_increase << ", "
+                  << "\"projects_done\": " << result.projects_done << ", "
+                  << "\"peak_rss_kb\": " << peak_rss_kb << "}"
+                  << (index + 1 < inputs.size() ? ",\n" : "\n");
+    }
+    std::cout << "]\n";
+    return exit_code;
+}
+
+int generate(const std::vector<std::string>& args)
+{
+    if (args.empty())
+    {
+        std::cerr << "Usage: sol1_bench generate <output> [--contributors N] [--projects N] [--skills N] [--roles N] "
+                     "[--levels N] [--seed N]\n";
+        return 2;
+    }
+
+    GeneratorConfig config;
+    for (size_t index = 1; index + 1 < args.size(); index += 2)
+    {
+        const auto& arg = args[index];
+        uint64_t value;
+        try
+        {
+            value = std::stoull(args[index + 1]);
+        }
+        catch (const std::logic_error&)
+        {
+            std::cerr << "Invalid value for " << arg << "\n";
+            return 2;
+        }
+        if (arg == "--contributors")
+            config.nr_contributors = value;
+        else if (arg == "--projects")
+            config.nr_projects = value;
+        else if (arg == "--skills")
+            config.nr_skills = value;
+        else if (arg == "--roles")
+            config.max_roles = value;
+        else if (arg == "--levels")
+            config.max_level = value;
+        else if (arg == "--seed")
+            config.seed = value;
+        else
+        {
+            std::cerr << "Unknown option " << arg << "\n";
+            return 2;
+        }
+    }
+    Generator::write_instance(config, args[0]);
+    return 0;
+}
+
+#ifdef SOL1_HAVE_BENCHMARK
+
+// Instance the micro benchmarks run on, loaded once
+std::string instance_path;
+
+const Data& instance()
+{
+    static Data data(instance_path);
+    return data;
+}
+
+// Projects that can be done on day 0, in priority order
+const std::vector<int>& feasible_projects()
+{
+    static std::vector<int> feasible = [](){
+        SimulationState simulation_state(instance(), instance().skill_matrix);
+        std::vector<int> projects;
+        for (int project_index = 0; project_index < instance().nr_projects; ++project_index)
+            if (simulation_state.can_project_be_done(project_index))
+                projects.push_back(project_index);
+        return projects;
+    }();
+    return feasible;
+}
+
+void BM_DataParsing(benchmark::State& state)
+{
+    for (auto _ : state)
+    {
+        Data data(instance_path);
+        benchmark::DoNotOptimize(data.projects.score.data());
+    }
+    state.SetBytesProcessed(state.iterations() * std::filesystem::file_size(instance_path));
+}
+BENCHMARK(BM_DataParsing)->Unit(benchmark::kMillisecond);
+
+void BM_CanProjectBeDone(benchmark::State& state)
+{
+    SimulationState simulation_state(instance(), instance().skill_matrix);
+    int project_index = 0;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(simulation_state.can_project_be_done(project_index));
+        project_index = (project_index + 1) % instance().nr_projects;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CanProjectBeDone);
+
+void BM_CollectFeasibleProjects(benchmark::State& state)
+{
+    SimulationState simulation_state(instance(), instance().skill_matrix);
+    std::vector<int> all_projects(instance().nr_projects), feasible;
+    std::iota(all_projects.begin(), all_projects.end(), 0);
+    for (auto _ : state)
+    {
+        feasible.clear();
+        simulation_state.collect_feasible_projects(all_projects, feasible);
+        benchmark::DoNotOptimize(feasible.data());
+    }
+    state.SetItemsProcessed(state.iterations() * all_projects.size());
+}
+BENCHMARK(BM_CollectFeasibleProjects)->Unit(benchmark::kMillisecond);
+
+// Heuristic keys of every project as the queue builds them, then the score of every project started on one day
+void BM_ScoreProjects(benchmark::State& state)
+{
+    const auto& projects = instance().projects;
+    std::vector<int> all_projects(projects.size()), scores(projects.size());
+    std::vector<int64_t> early_keys(projects.size()), late_keys(projects.size());
+    std::iota(all_projects.begin(), all_projects.end(), 0);
+    int day = 0;
+    for (auto _ : state)
+    {
+        projects.heuristic_keys(early_keys, late_keys);
+        projects.actual_scores(day, all_projects, scores);
+        benchmark::DoNotOptimize(early_keys.data());
+        benchmark::DoNotOptimize(late_keys.data());
+        benchmark::DoNotOptimize(scores.data());
+        day = (day + 1) % 1000;
+    }
+    state.SetItemsProcessed(state.iterations() * projects.size());
+}
+BENCHMARK(BM_ScoreProjects);
+
+// One search per iteration, cycling through the projects feasible on day 0. Items are search nodes
+void BM_FindAlloc(benchmark::State& state)
+{
+    const bool role_matching = state.range(0);
+    const auto& feasible = feasible_projects();
+    if (feasible.empty())
+    {
+        state.SkipWithError("no feasible project");
+        return;
+    }
+
+    SimulationState simulation_state(instance(), instance().skill_matrix);
+    SearchLimits limits{milliseconds(100)};
+    uint64_t nodes = 0, found = 0;
+    size_t next = 0;
+    for (auto _ : state)
+    {
+        const auto roles = instance().projects.roles(feasible[next]);
+        auto result = role_matching ? RoleMatcher::find_alloc(simulation_state, roles, limits)
+                                    : ProjectAllocator::find_alloc(simulation_state, roles, false, limits, next);
+        nodes += result.nodes;
+        found += result.found();
+        next = (next + 1) % feasible.size();
+    }
+    state.SetItemsProcessed(nodes);
+    state.counters["found"] = benchmark::Counter(found, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_FindAlloc)->ArgName("role_matching")->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond);
+
+// Applies the level-ups of an allocation and puts the old levels back, so that every iteration sees the same matrix
+void BM_UpdateContributors(benchmark::State& state)
+{
+    SimulationState simulation_state(instance(), instance().skill_matrix);
+    std::vector<ProjectAllocation> allocations;
+    for (int project_index : feasible_projects())
+    {
+        auto result = RoleMatcher::find_alloc(simulation_state, instance().projects.roles(project_index));
+        if (result.found())
+            allocations.emplace_back(project_index, std::move(result.contributor_ids));
+        if (allocations.size() == 256)
+            break;
+    }
+    if (allocations.empty())
+    {
+        state.SkipWithError("no allocation found");
+        return;
+    }
+
+    auto& skill_matrix = simulation_state.skill_matrix;
+    std::vector<int> old_levels;
+    size_t next = 0;
+    for (auto _ : state)
+    {
+        const auto& allocation = allocations[next];
+        const auto roles = instance().projects.roles(allocation.first);
+        old_levels.clear();
+        for (size_t role = 0; role < roles.size(); ++role)
+            old_levels.push_back(skill_matrix.level(allocation.second[role], roles[role].first));
+
+        ProjectAllocator::update_contributors(instance(), simulation_state, allocation);
+
+        for (size_t role = 0; role < roles.size(); ++role)
+            skill_matrix.set_level(allocation.second[role], roles[role].first, old_levels[role]);
+        next = (next + 1) % allocations.size();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_UpdateContributors);
+
+int micro(int argc, char** argv)
+{
+    // Our own flags go before the Google Benchmark ones
+    std::vector<char*> benchmark_args = {argv[0]};
+    for (int arg_index = 2; arg_index < argc; ++arg_index)
+    {
+        std::string arg = argv[arg_index];
+        if (arg == "--instance" && arg_index + 1 < argc)
+            instance_path = argv[++arg_index];
+        else
+            benchmark_args.push_back(argv[arg_index]);
+    }
+
+    if (instance_path.empty())
+    {
+        instance_path = (std::filesystem::temp_directory_path() / "sol1_bench_instance.in").string();
+        Generator::write_instance(GeneratorConfig{}, instance_path);
+    }
+
+    int benchmark_argc = benchmark_args.size();
+    benchmark::Initialize(&benchmark_argc, benchmark_args.data());
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
+
+#else
+
+int micro(int, char**)
+{
+    std::cerr << "sol1_bench was built without Google Benchmark, micro benchmarks are not available\n";
+    return 2;
+}
+
+#endif
+
+}
+
+int main(int argc, char** argv)
+{
+    std::string mode = argc > 1 ? argv[1] : "";
+    std::vector<std::string> args(argv + std::min(argc, 2), argv + argc);
+
+    if (mode == "generate")
+        return generate(args);
+    if (mode == "e2e")
+        return end_to_end(args);
+    if (mode == "micro")
+        return micro(argc, argv);
+
+    std::cerr << "Usage: sol1_bench generate|e2e|micro [options], see bench.cpp\n";
+    return 2;
+}
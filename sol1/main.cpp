@@ -1,102 +1,318 @@
-#include <set>
-#include <array>
-#include <bitset>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "Checkpoint.h"
 #include "Data.h"
-#include "ProjectAllocator.h"
+#include "ScheduleOptimizer.h"
+#include "ScheduleWriter.h"
+#include "Simulation.h"
+#include "Validator.h"
 
-ProjectAllocation get_best_allocation(const Data& data, SimulationState& simulation_state, int n)
-{
-    std::vector<ProjectAllocation> results;
+// Time the local search gets to improve each schedule after the simulation unless --optimize says otherwise, 0 skips it
+constexpr seconds OPTIMIZER_TIME_LIMIT{0};
+// How often a running simulation is saved next to its output, for --resume to continue from after a crash
+constexpr seconds CHECKPOINT_INTERVAL{5};
 
-    auto it = std::lower_bound(
-            data.projects.begin(), data.projects.end(), simulation_state.day,
-            [](const Project& p, int day) {
-                return p.best_before_day < day;
-            }
-    );
+// Usage: sol1 [--input-dir DIR] [--output-dir DIR] [--threads N] [--jobs N] [--seed N] [--time-limit [NAME=]MS]
+//             [--budget [NAME=]MS] [--optimize [NAME=]MS] [--engine backtracking|matcher] [--policy first|learning]
+//             [--large] [--resume] [inputs...]
+//
+// Solves the inputs side by side on the one global pool of worker threads, so the free cores go to whichever input
+// still has searches to run. Inputs are names in the input directory, with or without .in, or paths; without any, the
+// six files of the input directory are solved. --threads sizes the pool (one worker per core by default), --jobs caps
+// the inputs solved at the same time (all of them by default). --time-limit is the limit of every project search,
+// --budget switches to the anytime mode, where the simulation gets one wall-clock budget that it splits over its
+// searches and stops when it is spent, and --optimize is the budget of the local search, all for all inputs or, as
+// NAME=MS, for one. --engine picks the allocation search of every candidate project and --policy whether its variants
+// stop at the first allocation found (the default) or keep looking for more learning points until the time limit.
+// --large forces the sparse skill layout, which inputs with too many contributor x skill pairs for the dense one get
+// anyway; the local search needs the dense one. With more than one job, the log of every input goes to NAME.log in the
+// output directory and only a summary line per input is printed
+namespace
+{
 
-    int lower_bound = it - data.projects.begin();
-    int upper_bound = data.nr_projects;
+// A duration for all inputs, with overrides for some of them
+struct PerInput
+{
+    std::optional<milliseconds> all;
+    std::unordered_map<std::string, milliseconds> by_name;
 
-    std::priority_queue<std::pair<int, int>> pq;
-    for (int project_index = lower_bound; project_index < upper_bound; ++project_index)
-        if (simulation_state.can_project_be_done(project_index))
-            pq.emplace(simulation_state.heuristic_score(project_index), project_index);
+    // MS or NAME=MS
+    bool parse(const std::string& value)
+    {
+        try
+        {
+            auto separator = value.find('=');
+            if (separator == std::string::npos)
+                all = milliseconds(std::stoll(value));
+            else
+                by_name[value.substr(0, separator)] = milliseconds(std::stoll(value.substr(separator + 1)));
+            return true;
+        }
+        catch (const std::logic_error&)
+        {
+            return false;
+        }
+    }
 
-    WeightedAllocation best_allocation;
-    auto start = steady_clock::now();
-    while (!pq.empty())
+    [[nodiscard]] std::optional<milliseconds> for_input(const std::string& name) const
     {
-        auto [approx_score, project_index] = pq.top();
-        pq.pop();
+        auto it = by_name.find(name);
+        return it != by_name.end() ? std::optional(it->second) : all;
+    }
+};
 
-        const auto& project = data.projects[project_index];
-        auto [learning_points, contributor_names] = ProjectAllocator::find_allocation_for_project(simulation_state, project);
+struct Settings
+{
+    std::string input_dir = "../../input_files/";
+    std::string output_dir = "../../output_files/sol1/";
+    // 0: one worker per core
+    unsigned nr_threads = 0;
+    // 0: all inputs at once
+    size_t nr_jobs = 0;
+    std::optional<uint64_t> seed;
+    PerInput time_limit, budget, optimize;
+    SearchEngine engine = SearchEngine::Backtracking;
+    PortfolioPolicy policy = PortfolioPolicy::FirstFound;
+    SkillLayout skill_layout = SkillLayout::Auto;
+    bool resume = false;
+    std::vector<std::string> inputs;
+};
 
-        if (!contributor_names.empty())
+bool parse_settings(int argc, char** argv, Settings& settings)
+{
+    for (int index = 1; index < argc; ++index)
+    {
+        std::string arg = argv[index];
+        bool has_value = index + 1 < argc;
+        try
         {
-            if (!simulation_state.actual_score(project_index) && !learning_points)
-                simulation_state.project_done[project_index] = true;
-            else
+            if (arg == "--input-dir" && has_value)
+                settings.input_dir = argv[++index];
+            else if (arg == "--output-dir" && has_value)
+                settings.output_dir = argv[++index];
+            else if (arg == "--threads" && has_value)
+                settings.nr_threads = std::stoul(argv[++index]);
+            else if (arg == "--jobs" && has_value)
+                settings.nr_jobs = std::stoul(argv[++index]);
+            else if (arg == "--seed" && has_value)
+                settings.seed = std::stoull(argv[++index]);
+            else if (arg == "--time-limit" && has_value)
+            {
+                if (!settings.time_limit.parse(argv[++index]))
+                    return false;
+            }
+            else if (arg == "--budget" && has_value)
+            {
+                if (!settings.budget.parse(argv[++index]))
+                    return false;
+            }
+            else if (arg == "--optimize" && has_value)
+            {
+                if (!settings.optimize.parse(argv[++index]))
+                    return false;
+            }
+            else if (arg == "--engine" && has_value)
+            {
+                if (!parse_search_engine(argv[++index], settings.engine))
+                    return false;
+            }
+            else if (arg == "--policy" && has_value)
             {
-                best_allocation = {project_index, contributor_names};
-                break;
+                if (!parse_portfolio_policy(argv[++index], settings.policy))
+                    return false;
             }
+            else if (arg == "--large")
+                settings.skill_layout = SkillLayout::Sparse;
+            else if (arg == "--resume")
+                settings.resume = true;
+            else if (arg.starts_with("--"))
+                return false;
+            else
+                settings.inputs.push_back(arg);
+        }
+        catch (const std::logic_error&)
+        {
+            return false;
         }
     }
-    auto now = steady_clock::now();
-    auto elapsed = duration_cast<seconds>(now - start);
-    std::cout << "Got a new allocation in " << elapsed.count() << " seconds.\n";
 
-    return best_allocation;
+    for (auto* dir : {&settings.input_dir, &settings.output_dir})
+        if (!dir->ends_with('/'))
+            *dir += '/';
+    if (settings.inputs.empty())
+        settings.inputs = {"a_an_example", "b_better_start_small", "c_collaboration",
+                           "d_dense_schedule", "e_exceptional_skills", "f_find_great_mentors"};
+    if (!settings.nr_jobs || settings.nr_jobs > settings.inputs.size())
+        settings.nr_jobs = settings.inputs.size();
+    if (!settings.optimize.all && OPTIMIZER_TIME_LIMIT.count())
+        settings.optimize.all = OPTIMIZER_TIME_LIMIT;
+    return true;
 }
 
-SimulationState simulate(const Data& data, SimulationState simulation_state)
+// What gets printed for an input once it is done
+struct Summary
 {
-    while (simulation_state.day != NMAX)
-    {
-        auto best_allocation = get_best_allocation(data, simulation_state, 5);
+    std::string error;
+    ValidationResult validation;
+    size_t nr_projects = 0;
+    double seconds = 0;
+};
 
-        const auto& [project_id, contributor_names] = best_allocation;
+Summary solve(const Settings& settings, const std::string& input_path, const std::string& name, std::ostream& log)
+{
+    Summary summary;
+    auto start = steady_clock::now();
+    Data data(input_path, settings.skill_layout);
+    log << "Successfully read " << data.nr_contributors << " contributors, and " << data.nr_projects << " projects"
+        << (data.skill_matrix.is_sparse() ? ", sparse skill layout\n" : "\n");
 
-        // Pass days if nothing more can be done at this day
-        if (contributor_names.empty())
-        {
-            simulation_state.pass_days();
-            std::cout << "Passed day to " << simulation_state.day << std::endl;
-            continue;
-        }
+    // Searches of all inputs share the global pool, so every input may fan out over all of it
+    auto options = PortfolioOptions::sized_to(TaskScheduler::global(), settings.engine, settings.policy);
+    options.seed = settings.seed;
+    if (auto time_limit = settings.time_limit.for_input(name))
+        options.time_limit = *time_limit;
+    if (auto budget = settings.budget.for_input(name))
+        options.budget = TimeBudget(*budget);
 
-        simulation_state.add_allocation(best_allocation);
-        ProjectAllocator::update_contributors(data, simulation_state, best_allocation);
+    const auto checkpoint_filename = settings.output_dir + name + ".checkpoint";
+    auto resumed = settings.resume ? Checkpoint::read(checkpoint_filename, data) : std::nullopt;
+    if (resumed)
+        log << "Resuming on day " << resumed->day << " with " << resumed->proj_to_contrib.size() << " allocations\n";
+    SimulationState base_simulation = resumed ? std::move(*resumed) : SimulationState(data, data.skill_matrix);
+
+    // The output follows the schedule day by day, an interrupted run leaves what it allocated so far. The previous
+    // output stays until this run allocates something
+    ScheduleWriter output(data, settings.output_dir + name + ".out");
+    output.write(base_simulation.proj_to_contrib);
+    auto last_checkpoint = steady_clock::now();
+    auto result = simulate(data, base_simulation, options, log, [&](const SimulationState& state){
+        output.write(state.proj_to_contrib);
+        if (steady_clock::now() - last_checkpoint < CHECKPOINT_INTERVAL)
+            return;
+        Checkpoint::write(checkpoint_filename, data, state);
+        last_checkpoint = steady_clock::now();
+    });
+    auto schedule = std::move(result.proj_to_contrib);
+
+    auto budget = settings.optimize.for_input(name);
+    if (budget && budget->count() && data.skill_matrix.is_sparse())
+        log << "Skipping the local search, which needs the dense skill layout\n";
+    else if (budget && budget->count())
+    {
+        OptimizerOptions optimizer_options;
+        optimizer_options.time_limit = *budget;
+        optimizer_options.seed = settings.seed.value_or(std::random_device{}());
+        auto optimized = ScheduleOptimizer::optimize(data, schedule, optimizer_options);
+        if (!optimized.valid)
+            log << "Not optimizing a schedule the strict replay rejects\n";
+        else
+            log << "Optimized score " << optimized.initial_score << " -> " << optimized.score << " in "
+                << optimized.seconds << " s on " << optimized.nr_threads << " threads (" << optimized.moves
+                << " moves, " << optimized.accepted << " accepted)\n";
+        schedule = std::move(optimized.schedule);
+    }
 
-        const auto& project = data.projects[project_id];
-        int penalty = (project.best_before_day > simulation_state.day + project.length_in_days)? 0 : simulation_state.day + project.length_in_days - project.best_before_day;
-        int actual_score = std::max(0, (project.score - penalty));
-        simulation_state.score_so_far += actual_score;
+    // Replay the schedule independently of the simulation before writing it out. What was streamed is not validated,
+    // so the output of an invalid one is cut back to the allocations before the first invalid one, which are valid,
+    // and the checkpoint stays to resume from
+    summary.validation = Validator(data).validate(schedule, Validator::Timing::Strict);
+    if (!summary.validation.valid)
+    {
+        schedule.resize(summary.validation.nr_valid);
+        output.write(schedule);
+        log << "Invalid schedule: " << summary.validation.error << ", the output only keeps its first "
+            << schedule.size() << " allocations and the checkpoint stays\n";
+    }
+    else
+    {
+        log << "Validated score " << summary.validation.score << ", skill increase " << summary.validation.skill_increase << "\n";
+        output.write(schedule);
+        output.publish();
+        std::filesystem::remove(checkpoint_filename);
     }
-    return simulation_state;
+    // The counters are process wide, so with several jobs they cover the inputs running alongside too
+    PROFILE_FINAL_STATS(log, result.day);
+
+    summary.nr_projects = schedule.size();
+    summary.seconds = duration<double>(steady_clock::now() - start).count();
+    return summary;
 }
 
-int main()
-{
-    const std::string in_prefix = "../../input_files/";
-    const std::string out_prefix = "../../output_files/sol1/";
-    const std::array<std::string, 6> input_files = {"a_an_example.in", "b_better_start_small.in", "c_collaboration.in",
-                                          "d_dense_schedule.in", "e_exceptional_skills.in", "f_find_great_mentors.in"};
+}
 
-    for (const auto& input_file : input_files)
+int main(int argc, char** argv)
+{
+    PROFILE_THREAD_NAME("main");
+    Settings settings;
+    if (!parse_settings(argc, argv, settings))
     {
-        Data data(in_prefix + input_file);
+        std::cerr << "Usage: sol1 [--input-dir DIR] [--output-dir DIR] [--threads N] [--jobs N] [--seed N] "
+                     "[--time-limit [NAME=]MS] [--budget [NAME=]MS] [--optimize [NAME=]MS] "
+                     "[--engine backtracking|matcher] [--policy first|learning] [--large] [--resume] [inputs...]\n";
+        return 2;
+    }
+    // Before anything touches the global pool
+    if (settings.nr_threads)
+        TaskScheduler::set_global_size(settings.nr_threads);
+    PROFILE_RESET();
 
-        std::cout << "Successfully read " << data.nr_contributors << " contributors, and " << data.nr_projects << " projects\n";
+    // Every driver thread takes the next input nobody works on yet. Drivers are plain threads rather than pool tasks,
+    // so an input waiting on its searches never holds a worker
+    std::atomic<size_t> next_input = 0;
+    std::atomic<int> exit_code = 0;
+    std::mutex print_mutex;
+    auto drive = [&](){
+        for (size_t index; (index = next_input++) < settings.inputs.size();)
+        {
+            const auto& input = settings.inputs[index];
+            auto input_path = input.find('/') != std::string::npos ? input
+                              : settings.input_dir + (input.ends_with(".in") ? input : input + ".in");
+            auto name = std::filesystem::path(input_path).stem().string();
 
-        SimulationState base_simulation(data, data.skill_to_contributors);
-        auto result = simulate(data, base_simulation);
+            std::ofstream log_file;
+            if (settings.nr_jobs > 1)
+                log_file.open(settings.output_dir + name + ".log");
+            std::ostream& log = settings.nr_jobs > 1 ? log_file : std::cout;
 
-        const auto out_filename = out_prefix + input_file.substr(0, (input_file.find('.'))) + ".out";
-        data.write_to_file(out_filename, result.proj_to_contrib);
-    }
-    return 0;
-}
\ No newline at end of file
+            Summary summary;
+            try
+            {
+                summary = solve(settings, input_path, name, log);
+            }
+            catch (const std::exception& exception)
+            {
+                summary.error = exception.what();
+            }
+
+            if (!summary.error.empty() || !summary.validation.valid)
+                exit_code = 1;
+            std::lock_guard lock(print_mutex);
+            if (!summary.error.empty())
+                std::cout << name << ": failed: " << summary.error << std::endl;
+            else if (!summary.validation.valid)
+                std::cout << name << ": invalid schedule: " << summary.validation.error << std::endl;
+            else
+                std::cout << name << ": validated score " << summary.validation.score << ", skill increase "
+                          << summary.validation.skill_increase << ", " << summary.nr_projects << " projects in "
+                          << summary.seconds << " s" << std::endl;
+        }
+    };
+
+    std::vector<std::thread> drivers;
+    for (size_t job = 0; job < settings.nr_jobs; ++job)
+        drivers.emplace_back(drive);
+    for (auto& driver : drivers)
+        driver.join();
+
+    PROFILE_WRITE_TRACE(settings.output_dir + "sol1.trace.json");
+    return exit_code;
+}
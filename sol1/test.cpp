@@ -0,0 +1,290 @@
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Checkpoint.h"
+#include "Data.h"
+#include "Generator.h"
+#include "ScheduleWriter.h"
+#include "Simulation.h"
+#include "Validator.h"
+
+// Tests of the simulation state, run by ctest on small generated instances.
+//
+//   sol1_test [inputs...]
+//       Also runs the tests on the given inputs. Prints every check that failed and exits with 1 if any did
+namespace
+{
+
+int nr_failures = 0;
+
+void check(bool condition, const std::string& what)
+{
+    if (condition)
+        return;
+    std::cout << "FAILED: " << what << std::endl;
+    ++nr_failures;
+}
+
+// Everything a rollback has to restore, the project queue as the projects it holds
+struct StateView
+{
+    int day, score_so_far, queue_size;
+    std::vector<ProjectAllocation> proj_to_contrib;
+    std::vector<int> available_at;
+    std::vector<bool> project_done, in_queue;
+    std::vector<std::vector<std::pair<uint32_t, int>>> skills_of;
+
+    explicit StateView(const SimulationState& state)
+            : day(state.day)
+            , score_so_far(state.score_so_far)
+            , queue_size(state.project_queue.size())
+            , proj_to_contrib(state.proj_to_contrib)
+            , available_at(state.available_at)
+            , project_done(state.project_done)
+    {
+        for (int project_index = 0; project_index < state.data.nr_projects; ++project_index)
+            in_queue.push_back(state.project_queue.holds(project_index));
+        for (uint32_t contr_id = 0; contr_id < (uint32_t)state.data.nr_contributors; ++contr_id)
+        {
+            skills_of.push_back(state.skill_matrix.skills_of_contributor(contr_id));
+            std::sort(skills_of.back().begin(), skills_of.back().end());
+        }
+    }
+
+    void check_same(const StateView& other, const std::string& where) const
+    {
+        check(day == other.day, where + ": day");
+        check(score_so_far == other.score_so_far, where + ": score");
+        check(proj_to_contrib == other.proj_to_contrib, where + ": allocations");
+        check(available_at == other.available_at, where + ": availability");
+        check(project_done == other.project_done, where + ": done projects");
+        check(skills_of == other.skills_of, where + ": levels");
+        check(queue_size == other.queue_size, where + ": queue size " + std::to_string(queue_size) + " instead of " +
+                                              std::to_string(other.queue_size));
+        check(in_queue == other.in_queue, where + ": queued projects");
+    }
+};
+
+PortfolioOptions test_options()
+{
+    auto options = PortfolioOptions::sized_to(TaskScheduler::global(), SearchEngine::Backtracking,
+                                              PortfolioPolicy::MostLearning);
+    options.time_limit = milliseconds(20);
+    options.seed = 1;
+    return options;
+}
+
+// Allocating a day and rolling back leaves the state and the queue as they were, on every day of the simulation
+void test_rollback_within_day(const Data& data, const std::string& name)
+{
+    auto options = test_options();
+    std::ostringstream log;
+    SimulationState state(data, data.skill_matrix);
+    for (int nr_days = 0; state.day != NMAX && nr_days < 50; ++nr_days)
+    {
+        StateView before(state);
+        auto snapshot = state.snapshot();
+        allocate_day(data, state, options, log);
+        state.rollback(snapshot);
+        StateView(state).check_same(before, name + " rollback on day " + std::to_string(state.day));
+
+        state.forget_history();
+        allocate_day(data, state, options, log);
+        state.pass_days();
+    }
+    check(!state.keeps_history(), name + ": logging after forget_history");
+}
+
+// Rolling back over passed days rebuilds the queue of the day rolled back to
+void test_rollback_across_days(const Data& data, const std::string& name)
+{
+    auto options = test_options();
+    std::ostringstream log;
+    SimulationState state(data, data.skill_matrix);
+    for (int nr_days = 0; state.day != NMAX && nr_days < 20; ++nr_days)
+    {
+        StateView before(state);
+        auto snapshot = state.snapshot();
+        for (int ahead = 0; ahead < 3 && state.day != NMAX; ++ahead)
+        {
+            allocate_day(data, state, options, log);
+            state.pass_days();
+        }
+        state.rollback(snapshot);
+        StateView(state).check_same(before, name + " rollback to day " + std::to_string(state.day));
+
+        state.forget_history();
+        allocate_day(data, state, options, log);
+        state.pass_days();
+    }
+}
+
+// what_if leaves a state that did not log changes without a log
+void test_what_if(const Data& data, const std::string& name)
+{
+    auto options = test_options();
+    std::ostringstream log;
+    SimulationState state(data, data.skill_matrix);
+    SimulationState scratch = state;
+    auto allocations = allocate_day(data, scratch, options, log);
+    if (allocations.empty())
+        return;
+
+    StateView before(state);
+    int score = what_if(data, state, allocations.front(), [](const SimulationState& committed){
+        return committed.score_so_far;
+    });
+    check(score == data.projects.actual_score(allocations.front().first, 0), name + ": what_if score");
+    StateView(state).check_same(before, name + " what_if");
+    check(!state.keeps_history(), name + ": logging after what_if");
+}
+
+// A checkpoint reads back as the state it was written from, and one with an id or a size that does not fit the input
+// is refused instead of loaded
+void test_checkpoint(const Data& data, const std::string& name)
+{
+    auto options = test_options();
+    std::ostringstream log;
+    SimulationState state(data, data.skill_matrix);
+    for (int nr_days = 0; state.day != NMAX && nr_days < 20; ++nr_days)
+    {
+        allocate_day(data, state, options, log);
+        state.pass_days();
+    }
+    auto path = std::filesystem::temp_directory_path() / "sol1_test.ckpt";
+    Checkpoint::write(path.string(), data, state);
+    auto resumed = Checkpoint::read(path.string(), data);
+    check(resumed.has_value(), name + ": checkpoint not read back");
+    if (resumed)
+        StateView(*resumed).check_same(StateView(state), name + " checkpoint");
+
+    std::string bytes;
+    {
+        std::ifstream file(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(file), {});
+    }
+    // The header is 56 bytes with the sizes at its end, followed by the availability, the done bits, the allocations
+    // and the level changes
+    const size_t allocations_size_at = 40, nr_level_changes_at = 48;
+    const size_t allocations_at = 56 + data.nr_contributors * sizeof(int32_t) + (data.nr_projects + 7) / 8;
+    uint64_t allocations_size;
+    std::memcpy(&allocations_size, bytes.data() + allocations_size_at, sizeof(allocations_size));
+    const size_t level_changes_at = allocations_at + allocations_size * sizeof(uint32_t);
+
+    auto check_refused = [&](size_t offset, auto value, const std::string& what){
+        auto corrupt = bytes;
+        std::memcpy(corrupt.data() + offset, &value, sizeof(value));
+        std::ofstream(path, std::ios::binary | std::ios::trunc) << corrupt;
+        bool refused = false;
+        try
+        {
+            refused = !Checkpoint::read(path.string(), data);
+        }
+        catch (const std::runtime_error&)
+        {
+            refused = true;
+        }
+        check(refused, name + ": checkpoint with " + what + " loaded");
+    };
+    check_refused(allocations_size_at, uint64_t(1) << 60, "a huge allocations size");
+    check_refused(nr_level_changes_at, uint64_t(1) << 60, "a huge level change count");
+    if (allocations_size)
+    {
+        check_refused(allocations_at, (uint32_t)data.nr_projects, "a project out of range");
+        check_refused(allocations_at + sizeof(uint32_t), uint32_t(0), "a wrong contributor count");
+        check_refused(allocations_at + 2 * sizeof(uint32_t), (uint32_t)data.nr_contributors, "a contributor out of range");
+    }
+    if (level_changes_at < bytes.size())
+    {
+        check_refused(level_changes_at, (uint32_t)data.nr_contributors, "a level change of a contributor out of range");
+        check_refused(level_changes_at + sizeof(uint32_t), data.skill_matrix.nr_skills,
+                      "a level change of a skill out of range");
+    }
+    std::filesystem::remove(path);
+}
+
+// The output of the previous run stays in place until the new one has allocations, and an invalid schedule is only
+// valid up to nr_valid
+void test_schedule_writer(const Data& data, const std::string& name)
+{
+    auto options = test_options();
+    std::ostringstream log;
+    SimulationState state(data, data.skill_matrix);
+    for (int nr_days = 0; state.day != NMAX && nr_days < 5; ++nr_days)
+    {
+        allocate_day(data, state, options, log);
+        state.pass_days();
+    }
+    auto schedule = state.proj_to_contrib;
+    if (schedule.empty())
+        return;
+
+    auto path = std::filesystem::temp_directory_path() / "sol1_test.out";
+    auto read_back = [&](){
+        std::string error;
+        auto solution = Validator(data).read_solution(path.string(), error);
+        check(error.empty(), name + ": output not read back: " + error);
+        return solution;
+    };
+    {
+        ScheduleWriter previous(data, path.string());
+        previous.write(schedule);
+    }
+    {
+        ScheduleWriter output(data, path.string());
+        output.write({});
+        check(read_back() == schedule, name + ": previous output replaced before any allocation");
+        output.write({schedule.front()});
+        check(read_back() == decltype(schedule){schedule.front()}, name + ": output not replaced");
+        check(!std::filesystem::exists(path.string() + ".tmp"), name + ": temporary output left behind");
+    }
+
+    auto invalid = schedule;
+    invalid.push_back(schedule.front());
+    auto validation = Validator(data).validate(invalid, Validator::Timing::Strict);
+    check(!validation.valid && validation.nr_valid == schedule.size(), name + ": valid prefix of an invalid schedule");
+    std::filesystem::remove(path);
+}
+
+void run_tests(const std::string& input_path, const std::string& name)
+{
+    Data data(input_path);
+    test_rollback_within_day(data, name);
+    test_rollback_across_days(data, name);
+    test_what_if(data, name);
+    test_checkpoint(data, name);
+    test_schedule_writer(data, name);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    // Small enough for the searches to be quick, with enough feasible projects to allocate every day
+    GeneratorConfig config;
+    config.nr_contributors = 300;
+    config.nr_projects = 600;
+    config.nr_skills = 30;
+    config.max_roles = 5;
+    config.max_level = 4;
+    config.horizon = 600;
+    for (uint64_t seed = 1; seed <= 3; ++seed)
+    {
+        config.seed = seed;
+        auto path = std::filesystem::temp_directory_path() / ("sol1_test_" + std::to_string(seed) + ".in");
+        Generator::write_instance(config, path.string());
+        run_tests(path.string(), "generated " + std::to_string(seed));
+        std::filesystem::remove(path);
+    }
+    for (int index = 1; index < argc; ++index)
+        run_tests(argv[index], argv[index]);
+
+    std::cout << (nr_failures ? std::to_string(nr_failures) + " checks failed" : "All checks passed") << std::endl;
+    return nr_failures ? 1 : 0;
+}
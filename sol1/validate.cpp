@@ -0,0 +1,62 @@
+#include <array>
+#include <iostream>
+#include <string>
+#include "Data.h"
+#include "Validator.h"
+
+// Scores the outputs of sol1 the same way validate.py does.
+// Usage: sol1_validate [--strict] [repository root, ../../ by default]
+int main(int argc, char** argv)
+{
+    auto timing = Validator::Timing::Reference;
+    std::string root = "../../";
+    for (int arg_index = 1; arg_index < argc; ++arg_index)
+    {
+        std::string arg = argv[arg_index];
+        if (arg == "--strict")
+            timing = Validator::Timing::Strict;
+        else
+            root = arg.ends_with('/') ? arg : arg + '/';
+    }
+
+    const std::array<std::string, 1> solutions = {"sol1"};
+    const std::array<std::string, 6> input_files = {"a_an_example", "b_better_start_small", "c_collaboration",
+                                                    "d_dense_schedule", "e_exceptional_skills", "f_find_great_mentors"};
+
+    int exit_code = 0;
+    for (const auto& solution : solutions)
+    {
+        std::cout << "For " << solution << " we got:\n";
+        for (const auto& input_file : input_files)
+        {
+            Data data(root + "input_files/" + input_file + ".in");
+            Validator validator(data);
+
+            // validate.py reports the path relative to the repository root
+            const auto solution_path = "output_files/" + solution + "/" + input_file + ".out";
+            std::string error;
+            std::vector<ProjectAllocation> schedule;
+            try
+            {
+                schedule = validator.read_solution(root + solution_path, error);
+            }
+            catch (const std::runtime_error&)
+            {
+                std::cout << "Error: File '" << solution_path << "' not found.\n";
+                continue;
+            }
+
+            auto result = error.empty() ? validator.validate(schedule, timing) : ValidationResult{false, error};
+            if (!result.valid)
+            {
+                std::cout << "--->For " << input_file << " the solution is invalid: " << result.error << ".\n\n";
+                exit_code = 1;
+                continue;
+            }
+            std::cout << "--->For " << input_file << " we obtained score = "
+                      << Validator::with_thousands_separators(result.score) << ", skill_increase = "
+                      << Validator::with_thousands_separators(result.skill_increase) << ".\n\n";
+        }
+    }
+    return exit_code;
+}